@@ -84,10 +84,13 @@ static void doHelp() {
             PRINTF("  stop:  close output file to finish recording\n");
             break;
         } else if (!STRCMP(argArray[1], "set")) {
-            PRINTF("Change BIOS settings\n");
+            PRINTF("Change BIOS and cpu settings\n");
             PRINTF("\nSET <item> <value>\n");
             PRINTF("  available items and values\n");
             PRINTF("  boot   fdd, hdd\n");
+            PRINTF("  jit    on, off\n");
+            PRINTF("  rtc    host, <yyyy-mm-dd> [hh:mm:ss]\n");
+            PRINTF("  speed  max, <mips>\n");
             break;
         } else if (!STRCMP(argArray[1], "device")) {
             PRINTF("Change NXVM devices\n");
@@ -136,7 +139,7 @@ static void doHelp() {
         PRINTF("DEBUG   Launch NXVM hardware debugger\n");
         PRINTF("RECORD  Record cpu status for each instruction\n");
         PRINTF("\n");
-        PRINTF("SET     Change BIOS settings\n");
+        PRINTF("SET     Change BIOS and cpu settings\n");
         PRINTF("DEVICE  Change hardware parts\n");
         PRINTF("\n");
         PRINTF("START   Start virtual machine\n");
@@ -181,6 +184,7 @@ static void doInfo() {
     PRINTF("NXVM Device Status\n");
     PRINTF("==================\n");
     devicePrintStatus();
+    devicePrintCpuStat();
 }
 
 /* Starts internal debugger */
@@ -212,6 +216,27 @@ static void doRecord() {
     }
 }
 
+/* Starts rtc from date "yyyy-mm-dd" and time "hh:mm:ss", returns 0 if invalid */
+static int setRtcDate(const char *date, const char *time) {
+    int year, month, mday, hour, minute, second;
+    if (STRLEN(date) != 10 || date[4] != '-' || date[7] != '-' ||
+            STRLEN(time) != 8 || time[2] != ':' || time[5] != ':') {
+        return 0;
+    }
+    year = atoi(date);
+    month = atoi(date + 5);
+    mday = atoi(date + 8);
+    hour = atoi(time);
+    minute = atoi(time + 3);
+    second = atoi(time + 6);
+    if (year < 1970 || year > 9999 || month < 1 || month > 12 || mday < 1 || mday > 31 ||
+            hour > 23 || minute > 59 || second > 59) {
+        return 0;
+    }
+    deviceConnectCmosSetDate(year, month, mday, hour, minute, second);
+    return 1;
+}
+
 /* Sets BIOS settings */
 static void doSet() {
     if (numArgs < 2) {
@@ -228,6 +253,39 @@ static void doSet() {
         } else {
             GetHelp;
         }
+    } else if (!STRCMP(argArray[1], "jit")) {
+        if (numArgs != 3) {
+            GetHelp;
+        }
+        if (!STRCMP(argArray[2], "on")) {
+            if (deviceConnectCpuSetJit(1)) {
+                PRINTF("JIT is not supported on this host.\n");
+            }
+        } else if (!STRCMP(argArray[2], "off")) {
+            deviceConnectCpuSetJit(0);
+        } else {
+            GetHelp;
+        }
+    } else if (!STRCMP(argArray[1], "rtc")) {
+        if (numArgs != 3 && numArgs != 4) {
+            GetHelp;
+        }
+        if (!STRCMP(argArray[2], "host")) {
+            deviceConnectCmosSetHostDate();
+        } else if (!setRtcDate(argArray[2], (numArgs == 4) ? argArray[3] : "00:00:00")) {
+            GetHelp;
+        }
+    } else if (!STRCMP(argArray[1], "speed")) {
+        if (numArgs != 3) {
+            GetHelp;
+        }
+        if (!STRCMP(argArray[2], "max")) {
+            deviceConnectMachineSetSpeed(0);
+        } else if (atoi(argArray[2]) > 0 && atoi(argArray[2]) <= 4000) {
+            deviceConnectMachineSetSpeed(atoi(argArray[2]));
+        } else {
+            GetHelp;
+        }
     } else {
         GetHelp;
     }
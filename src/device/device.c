@@ -46,6 +46,7 @@ void deviceReset() {
 /* Issues stopping signal to device thread */
 void deviceStop()  {
     device.flagRun = False;
+    utilsWake();
 }
 
 /* Initializes devices */
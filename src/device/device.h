@@ -34,6 +34,14 @@ void deviceConnectDebugRecordStop();
 void deviceConnectBiosSetBoot(int flagHdd);
 int deviceConnectBiosGetBoot();
 
+/* Machine Settings */
+void deviceConnectMachineSetSpeed(uint32_t mips);
+
+/* CMOS Settings */
+void deviceConnectCmosSetDate(uint16_t year, uint8_t month, uint8_t mday,
+                              uint8_t hour, uint8_t minute, uint8_t second);
+void deviceConnectCmosSetHostDate();
+
 /* CPU Operations */
 int deviceConnectCpuReadLinear(uint32_t linear, void *rdest, uint8_t size);
 int deviceConnectCpuWriteLinear(uint32_t linear, void *rsrc, uint8_t size);
@@ -49,6 +57,7 @@ void deviceConnectCpuSetWE(uint32_t linear);
 void deviceConnectCpuClearWR();
 void deviceConnectCpuClearWW();
 void deviceConnectCpuClearWE();
+int deviceConnectCpuSetJit(int flagJit);
 
 int deviceConnectCpuGetCsDefSize();
 uint32_t deviceConnectCpuGetCsBase();
@@ -256,6 +265,7 @@ void devicePrintCpuCreg();
 void devicePrintCpuReg();
 void devicePrintCpuMem();
 void devicePrintCpuWatch();
+void devicePrintCpuStat();
 void devicePrintPic();
 void devicePrintPit();
 void devicePrintDma();
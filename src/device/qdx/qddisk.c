@@ -35,6 +35,8 @@ static void INT_13_02_HDD_ReadSector() {
     } else {
         MEMCPY((void *) vramGetRealAddr(vcpu.data.es.selector,vcpu.data.bx),
                (void *) vhddGetAddress(cyl,head,sector), vcpu.data.al * vhdd.data.nbyte);
+        vramMarkPhysical((t_nubit32)(vramGetRealAddr(vcpu.data.es.selector,vcpu.data.bx) - vram.connect.pBase),
+                         vcpu.data.al * vhdd.data.nbyte);
         vcpu.data.ah = 0x00;
         ClrBit(vcpu.data.eflags, VCPU_EFLAGS_CF);
     }
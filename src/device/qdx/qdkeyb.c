@@ -6,6 +6,7 @@
 #include "../vport.h"
 #include "../vcpu.h"
 #include "../vpic.h"
+#include "../vmachine.h"
 
 #include "qdx.h"
 #include "qdkeyb.h"
@@ -43,14 +44,20 @@ static t_nubit16 bufPeek() {
 
 static void qdkeybReadInput() {
     /* TODO: this should have been working with INT 15 */
-    while (bufIsEmpty) {
-        utilsSleep(10);
+    if (bufIsEmpty) {
+        /* waits like a bios does with sti and hlt, so that devices keep running;
+         * the key press interrupt wakes cpu up and the service is executed again */
+        vcpu.data.eip -= 2;
+        _SetEFLAGS_IF;
+        vcpu.data.flagHalt = True;
+        return;
     }
     vcpu.data.ax = bufPop();
     vpicSetIRQ(0x01);
 }
 static void qdkeybGetStatus() {
     t_nubit16 x = bufPeek();
+    vmachineWatch(QDKEYB_VBIOS_ADDR_KEYB_BUF_HEAD, (bufptrHead << 16) | bufptrTail);
     if (bufIsEmpty) {
         _SetEFLAGS_ZF;
     } else {
@@ -232,4 +239,6 @@ void deviceConnectKeyboardRecvKeyPress(uint16_t code) {
     } */
     bufPush(code);
     vpicSetIRQ(0x01);
+    /* wakes up a halted cpu waiting for host time to pass */
+    utilsWake();
 }
@@ -8,10 +8,173 @@
 
 #include "vbios.h"
 #include "vport.h"
+#include "vpic.h"
+#include "vmachine.h"
 #include "vcmos.h"
 
 t_cmos vcmos;
 
+#define NS_PER_SEC 1000000000
+#define SEC_PER_DAY 86400
+/* update cycle at the end of each second, while reg a reports update in progress */
+#define UIP_NS 244000
+
+static t_nubit8 eventTick;
+
+/* Returns days since 1970-01-01 of a date in the gregorian calendar */
+static t_nubit64 DaysFromCivil(t_nubit32 year, t_nubit32 month, t_nubit32 mday) {
+    t_nubit32 era, yoe, doy;
+    year -= (month <= 2);
+    era = year / 400;
+    yoe = year - era * 400;
+    doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + mday - 1;
+    return (t_nubit64) era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+/* Returns date of days since 1970-01-01 */
+static void CivilFromDays(t_nubit64 days, t_nubit32 *year, t_nubit32 *month, t_nubit32 *mday) {
+    t_nubit32 era, doe, yoe, doy, mp;
+    days += 719468;
+    era = (t_nubit32)(days / 146097);
+    doe = (t_nubit32)(days - (t_nubit64) era * 146097);
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+    *mday = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+/* Converts between register value and number in current data mode */
+static t_nubit8 Encode(t_nubit32 value) {
+    value %= 100;
+    return GetBit(vcmos.connect.reg[VCMOS_RTC_REG_B], VCMOS_RTC_REG_B_DM) ?
+           GetMax8(value) : GetMax8(Hex2BCD(value));
+}
+static t_nubit32 Decode(t_nubit8 value) {
+    return GetBit(vcmos.connect.reg[VCMOS_RTC_REG_B], VCMOS_RTC_REG_B_DM) ?
+           value : BCD2Hex(value);
+}
+
+/* Returns virtual nanoseconds elapsed since rtc base */
+static t_nubit64 GetElapsed() {
+    return vmachineGetTime() - vcmos.data.baseTime;
+}
+/* Returns rtc time in seconds since 1970-01-01 */
+static t_nubit64 GetSeconds() {
+    return vcmos.data.base + GetElapsed() / NS_PER_SEC;
+}
+/* Restarts rtc from seconds since 1970-01-01 now */
+static void SetBase(t_nubit64 seconds) {
+    vcmos.data.base = seconds;
+    vcmos.data.baseTime = vmachineGetTime();
+    vcmos.data.second = 0;
+}
+/* Restarts rtc from time registers set by guest */
+static void LoadRegs() {
+    t_nubit32 year, month, mday;
+    year = Decode(vcmos.connect.reg[VCMOS_RTC_CENTURY]) * 100 +
+           Decode(vcmos.connect.reg[VCMOS_RTC_YEAR]);
+    month = Decode(vcmos.connect.reg[VCMOS_RTC_MONTH]);
+    mday = Decode(vcmos.connect.reg[VCMOS_RTC_DAY_MONTH]);
+    if (year < 1970) year = 1970;
+    if (month < 1 || month > 12) month = 1;
+    if (mday < 1 || mday > 31) mday = 1;
+    SetBase(DaysFromCivil(year, month, mday) * SEC_PER_DAY +
+            Decode(vcmos.connect.reg[VCMOS_RTC_HOUR]) % 24 * 3600 +
+            Decode(vcmos.connect.reg[VCMOS_RTC_MINUTE]) % 60 * 60 +
+            Decode(vcmos.connect.reg[VCMOS_RTC_SECOND]) % 60);
+}
+/* Restarts rtc from fixed date or host local time */
+static void LoadStart() {
+    time_t tCurr;
+    struct tm *ptm;
+    if (vcmos.connect.flagFixed) {
+        SetBase(vcmos.connect.start);
+        return;
+    }
+    tCurr = time(NULL);
+    ptm = LOCALTIME(&tCurr);
+    SetBase(DaysFromCivil(1900 + ptm->tm_year, ptm->tm_mon + 1, ptm->tm_mday) * SEC_PER_DAY +
+            ptm->tm_hour * 3600 + ptm->tm_min * 60 + ptm->tm_sec);
+}
+
+/* Returns frequency of periodic interrupt, or zero if disabled */
+static t_nubit32 GetPeriodFreq() {
+    t_nubit8 rate = vcmos.connect.reg[VCMOS_RTC_REG_A] & VCMOS_RTC_REG_A_RS;
+    switch (rate) {
+    case 0x00:
+        return 0;
+    case 0x01:
+        return 256;
+    case 0x02:
+        return 128;
+    default:
+        return 0x10000 >> rate;
+    }
+}
+/* Raises register c flags for updates and periodic ticks passed by */
+static void Sync() {
+    t_nubit64 second, period;
+    t_nubit32 freq = GetPeriodFreq();
+    if (!GetBit(vcmos.connect.reg[VCMOS_RTC_REG_B], VCMOS_RTC_REG_B_SET)) {
+        second = GetElapsed() / NS_PER_SEC;
+        if (second > vcmos.data.second) {
+            vcmos.data.second = second;
+            SetBit(vcmos.data.flags, VCMOS_RTC_REG_C_UF);
+            vcmosRefresh();
+            if ((vcmos.connect.reg[VCMOS_RTC_SECOND_ALARM] >= 0xc0 ||
+                    vcmos.connect.reg[VCMOS_RTC_SECOND_ALARM] == vcmos.connect.reg[VCMOS_RTC_SECOND]) &&
+                    (vcmos.connect.reg[VCMOS_RTC_MINUTE_ALARM] >= 0xc0 ||
+                     vcmos.connect.reg[VCMOS_RTC_MINUTE_ALARM] == vcmos.connect.reg[VCMOS_RTC_MINUTE]) &&
+                    (vcmos.connect.reg[VCMOS_RTC_HOUR_ALARM] >= 0xc0 ||
+                     vcmos.connect.reg[VCMOS_RTC_HOUR_ALARM] == vcmos.connect.reg[VCMOS_RTC_HOUR])) {
+                SetBit(vcmos.data.flags, VCMOS_RTC_REG_C_AF);
+            }
+        }
+    }
+    if (freq) {
+        period = vmachineGetTicks(freq);
+        if (period > vcmos.data.period) {
+            vcmos.data.period = period;
+            SetBit(vcmos.data.flags, VCMOS_RTC_REG_C_PF);
+        }
+    }
+}
+/* Schedules the next update or periodic tick that has its interrupt enabled */
+static void Schedule() {
+    t_nubit64 clock, next = Max64;
+    t_nubit8 regB = vcmos.connect.reg[VCMOS_RTC_REG_B];
+    t_nubit32 freq = GetPeriodFreq();
+    if (GetBit(regB, VCMOS_RTC_REG_B_PIE) && freq) {
+        next = vmachineGetClock(vmachineGetTicks(freq) + 1, freq);
+    }
+    if (GetBit(regB, VCMOS_RTC_REG_B_UIE | VCMOS_RTC_REG_B_AIE) &&
+            !GetBit(regB, VCMOS_RTC_REG_B_SET)) {
+        clock = vmachineGetClock(vcmos.data.baseTime +
+                                 (GetElapsed() / NS_PER_SEC + 1) * NS_PER_SEC, NS_PER_SEC);
+        if (clock < next) {
+            next = clock;
+        }
+    }
+    if (next == Max64) {
+        vmachineClearEvent(eventTick);
+    } else {
+        vmachineSetEvent(eventTick, next);
+    }
+}
+/* Raises irq 8 when a flag with its interrupt enabled comes up */
+static void Tick() {
+    t_nubit8 flags = vcmos.data.flags;
+    Sync();
+    /* flags in register c sit at the positions of their enables in register b */
+    flags = vcmos.data.flags & ~flags & vcmos.connect.reg[VCMOS_RTC_REG_B] &
+            (VCMOS_RTC_REG_C_UF | VCMOS_RTC_REG_C_AF | VCMOS_RTC_REG_C_PF);
+    if (flags) {
+        vpicSetIRQ(0x08);
+    }
+    Schedule();
+}
+
 static void io_write_0070() {
     vcmos.data.regId = vport.data.ioByte; /* select reg id */
     if (GetMSB8(vcmos.data.regId)) {
@@ -20,10 +183,50 @@ static void io_write_0070() {
     } else {
         vcpu.data.flagMaskNMI = False;
     }
+    vcmos.data.regId &= 0x7f;
 }
 static void io_write_0071() {
     t_nubitcc i;
     t_nubit16 checksum = Zero16;
+    t_nubit8 regB = vcmos.connect.reg[VCMOS_RTC_REG_B];
+    switch (vcmos.data.regId) {
+    case VCMOS_RTC_SECOND:
+    case VCMOS_RTC_MINUTE:
+    case VCMOS_RTC_HOUR:
+    case VCMOS_RTC_DAY_MONTH:
+    case VCMOS_RTC_MONTH:
+    case VCMOS_RTC_YEAR:
+    case VCMOS_RTC_CENTURY:
+        vcmosRefresh();
+        vcmos.connect.reg[vcmos.data.regId] = vport.data.ioByte;
+        if (!GetBit(regB, VCMOS_RTC_REG_B_SET)) {
+            LoadRegs();
+        }
+        Schedule();
+        return;
+    case VCMOS_RTC_REG_A:
+        Sync();
+        vcmos.connect.reg[VCMOS_RTC_REG_A] = vport.data.ioByte & ~VCMOS_RTC_REG_A_UIP;
+        vcmos.data.period = GetPeriodFreq() ? vmachineGetTicks(GetPeriodFreq()) : 0;
+        Schedule();
+        return;
+    case VCMOS_RTC_REG_B:
+        /* freezes time registers when set, and restarts from them when cleared */
+        Sync();
+        vcmosRefresh();
+        vcmos.connect.reg[VCMOS_RTC_REG_B] = vport.data.ioByte;
+        if (GetBit(regB, VCMOS_RTC_REG_B_SET) && !GetBit(vport.data.ioByte, VCMOS_RTC_REG_B_SET)) {
+            LoadRegs();
+        }
+        Schedule();
+        return;
+    case VCMOS_RTC_REG_C:
+    case VCMOS_RTC_REG_D:
+        /* read only */
+        return;
+    default:
+        break;
+    }
     vcmos.connect.reg[vcmos.data.regId] = vport.data.ioByte;
     if ((vcmos.data.regId >= VCMOS_TYPE_DISK_FLOPPY) && (vcmos.data.regId < VCMOS_CHECKSUM_MSB)) {
         for (i = VCMOS_TYPE_DISK_FLOPPY; i < VCMOS_CHECKSUM_MSB; ++i) {
@@ -34,53 +237,90 @@ static void io_write_0071() {
     vcmos.connect.reg[VCMOS_CHECKSUM_MSB] = GetMax8(checksum >> 8);
 }
 static void io_read_0071() {
+    t_nubit8 flags;
+    switch (vcmos.data.regId) {
+    case VCMOS_RTC_REG_A:
+        vport.data.ioByte = vcmos.connect.reg[VCMOS_RTC_REG_A];
+        if (!GetBit(vcmos.connect.reg[VCMOS_RTC_REG_B], VCMOS_RTC_REG_B_SET) &&
+                GetElapsed() % NS_PER_SEC >= NS_PER_SEC - UIP_NS) {
+            SetBit(vport.data.ioByte, VCMOS_RTC_REG_A_UIP);
+        }
+        return;
+    case VCMOS_RTC_REG_C:
+        /* reading clears all flags */
+        Sync();
+        flags = vcmos.data.flags;
+        if (flags & vcmos.connect.reg[VCMOS_RTC_REG_B] &
+                (VCMOS_RTC_REG_C_UF | VCMOS_RTC_REG_C_AF | VCMOS_RTC_REG_C_PF)) {
+            SetBit(flags, VCMOS_RTC_REG_C_IRQF);
+        }
+        vcmos.data.flags = Zero8;
+        vport.data.ioByte = flags;
+        return;
+    case VCMOS_RTC_REG_D:
+        vport.data.ioByte = VCMOS_RTC_REG_D_VRT;
+        return;
+    default:
+        break;
+    }
+    vcmosRefresh();
     vport.data.ioByte = vcmos.connect.reg[vcmos.data.regId];
 }
 
 void vcmosInit() {
     MEMSET((void *)(&vcmos), Zero8, sizeof(t_cmos));
+    vcmos.connect.reg[VCMOS_RTC_REG_A] = 0x26;
     vportAddRead(0x0071, (t_faddrcc) io_read_0071);
     vportAddWrite(0x0070, (t_faddrcc) io_write_0070);
     vportAddWrite(0x0071, (t_faddrcc) io_write_0071);
     vbiosAddPost(VCMOS_POST);
     vbiosAddInt(VCMOS_INT_HARD_RTC_08, 0x08);
     vbiosAddInt(VCMOS_INT_SOFT_RTC_1A, 0x1a);
+    eventTick = vmachineAddEvent((t_faddrcc) Tick);
     vcmosReset();
-    vcmosRefresh();
 }
 void vcmosReset() {
     MEMSET((void *)(&vcmos.data), Zero8, sizeof(t_cmos_data));
+    ClrBit(vcmos.connect.reg[VCMOS_RTC_REG_B], VCMOS_RTC_REG_B_SET);
+    LoadStart();
+    vcmosRefresh();
+    Schedule();
 }
+/* Brings time registers to current rtc time, unless guest is setting them */
 void vcmosRefresh() {
-    static time_t tPrev = 0;
-    time_t tCurr;
-    struct tm *ptm;
-    t_nubit8 century, year, month, mday, wday, hour, min, sec;
-
-    tCurr = time(NULL);
-    if (tCurr == tPrev) {
+    t_nubit64 seconds, days;
+    t_nubit32 year, month, mday;
+    if (GetBit(vcmos.connect.reg[VCMOS_RTC_REG_B], VCMOS_RTC_REG_B_SET)) {
         return;
-    } else {
-        tPrev = tCurr;
     }
-    ptm = LOCALTIME(&tCurr);
-
-    century = GetMax8(19 + ptm->tm_year / 100);
-    year    = GetMax8(ptm->tm_year % 100);
-    month   = GetMax8(ptm->tm_mon + 1);
-    mday    = GetMax8(ptm->tm_mday);
-    wday    = GetMax8(ptm->tm_wday + 1);
-    hour    = GetMax8(ptm->tm_hour);
-    min     = GetMax8(ptm->tm_min);
-    sec     = GetMax8(ptm->tm_sec);
+    seconds = GetSeconds();
+    days = seconds / SEC_PER_DAY;
+    seconds %= SEC_PER_DAY;
+    CivilFromDays(days, &year, &month, &mday);
 
-    vcmos.connect.reg[VCMOS_RTC_SECOND]    = Hex2BCD(sec);
-    vcmos.connect.reg[VCMOS_RTC_MINUTE]    = Hex2BCD(min);
-    vcmos.connect.reg[VCMOS_RTC_HOUR]      = Hex2BCD(hour);
-    vcmos.connect.reg[VCMOS_RTC_DAY_WEEK]  = Hex2BCD(wday);
-    vcmos.connect.reg[VCMOS_RTC_DAY_MONTH] = Hex2BCD(mday);
-    vcmos.connect.reg[VCMOS_RTC_MONTH]     = Hex2BCD(month);
-    vcmos.connect.reg[VCMOS_RTC_YEAR]      = Hex2BCD(year);
-    vcmos.connect.reg[VCMOS_RTC_CENTURY]   = Hex2BCD(century);
+    vcmos.connect.reg[VCMOS_RTC_SECOND]    = Encode((t_nubit32)(seconds % 60));
+    vcmos.connect.reg[VCMOS_RTC_MINUTE]    = Encode((t_nubit32)(seconds / 60 % 60));
+    vcmos.connect.reg[VCMOS_RTC_HOUR]      = Encode((t_nubit32)(seconds / 3600));
+    vcmos.connect.reg[VCMOS_RTC_DAY_WEEK]  = Encode((t_nubit32)((days + 4) % 7 + 1));
+    vcmos.connect.reg[VCMOS_RTC_DAY_MONTH] = Encode(mday);
+    vcmos.connect.reg[VCMOS_RTC_MONTH]     = Encode(month);
+    vcmos.connect.reg[VCMOS_RTC_YEAR]      = Encode(year % 100);
+    vcmos.connect.reg[VCMOS_RTC_CENTURY]   = Encode(year / 100);
 }
 void vcmosFinal() {}
+
+/* Starts rtc from fixed date at every reset, for reproducible guest runs */
+void deviceConnectCmosSetDate(uint16_t year, uint8_t month, uint8_t mday,
+                              uint8_t hour, uint8_t minute, uint8_t second) {
+    vcmos.connect.flagFixed = True;
+    vcmos.connect.start = DaysFromCivil(year, month, mday) * SEC_PER_DAY +
+                          hour * 3600 + minute * 60 + second;
+    LoadStart();
+    Schedule();
+}
+/* Starts rtc from host local time at every reset */
+void deviceConnectCmosSetHostDate() {
+    vcmos.connect.flagFixed = False;
+    LoadStart();
+    Schedule();
+}
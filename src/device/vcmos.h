@@ -13,10 +13,15 @@ extern "C" {
 
 typedef struct {
     t_nubit8 reg[0x80]; /* cmos registers */
+    t_bool flagFixed;   /* rtc starts from fixed date (1) or host clock (0) at reset */
+    t_nubit64 start;    /* fixed date in seconds since 1970-01-01 */
 } t_cmos_connect;
 
 typedef struct {
     t_nubit8 regId; /* id of specified cmos register*/
+    t_nubit64 base, baseTime; /* rtc seconds since 1970-01-01 at virtual nanoseconds */
+    t_nubit64 second, period; /* last update and periodic tick accounted in flags */
+    t_nubit8 flags; /* register c flags raised since last read */
 } t_cmos_data;
 
 typedef struct {
@@ -58,6 +63,19 @@ extern t_cmos vcmos;
 #define VCMOS_RTC_CENTURY      0x32
 #define VCMOS_FLAGS_INFO       0x33
 
+#define VCMOS_RTC_REG_A_RS  0x0f /* periodic interrupt rate */
+#define VCMOS_RTC_REG_A_UIP 0x80 /* update in progress */
+#define VCMOS_RTC_REG_B_DM  0x04 /* binary (1) or bcd (0) data mode */
+#define VCMOS_RTC_REG_B_UIE 0x10 /* update-ended interrupt enable */
+#define VCMOS_RTC_REG_B_AIE 0x20 /* alarm interrupt enable */
+#define VCMOS_RTC_REG_B_PIE 0x40 /* periodic interrupt enable */
+#define VCMOS_RTC_REG_B_SET 0x80 /* updates stopped for setting time */
+#define VCMOS_RTC_REG_C_UF   0x10
+#define VCMOS_RTC_REG_C_AF   0x20
+#define VCMOS_RTC_REG_C_PF   0x40
+#define VCMOS_RTC_REG_C_IRQF 0x80
+#define VCMOS_RTC_REG_D_VRT  0x80 /* valid ram and time */
+
 void vcmosInit();
 void vcmosReset();
 void vcmosRefresh();
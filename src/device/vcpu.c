@@ -136,6 +136,13 @@ void deviceConnectCpuClearWW() {
 void deviceConnectCpuClearWE() {
     vcpuins.data.flagWE = False;
 }
+int deviceConnectCpuSetJit(int flagJit) {
+    if (flagJit && !vcpuins.connect.jitCode) {
+        return 1;
+    }
+    vcpuins.connect.flagJit = !!flagJit;
+    return 0;
+}
 
 int deviceConnectCpuGetCsDefSize() {
     return vcpu.data.cs.seg.exec.defsize;
@@ -145,18 +152,23 @@ uint32_t deviceConnectCpuGetCsBase() {
 }
 
 int deviceConnectCpuGetCF() {
+    vcpuinsSyncFlags();
     return _GetEFLAGS_CF;
 }
 int deviceConnectCpuGetPF() {
+    vcpuinsSyncFlags();
     return _GetEFLAGS_PF;
 }
 int deviceConnectCpuGetAF() {
+    vcpuinsSyncFlags();
     return _GetEFLAGS_AF;
 }
 int deviceConnectCpuGetZF() {
+    vcpuinsSyncFlags();
     return _GetEFLAGS_ZF;
 }
 int deviceConnectCpuGetSF() {
+    vcpuinsSyncFlags();
     return _GetEFLAGS_SF;
 }
 int deviceConnectCpuGetTF() {
@@ -169,6 +181,7 @@ int deviceConnectCpuGetDF() {
     return _GetEFLAGS_DF;
 }
 int deviceConnectCpuGetOF() {
+    vcpuinsSyncFlags();
     return _GetEFLAGS_OF;
 }
 int deviceConnectCpuGetNT() {
@@ -182,18 +195,23 @@ int deviceConnectCpuGetVM() {
 }
 
 void deviceConnectCpuSetCF() {
+    vcpuinsSyncFlags();
     _SetEFLAGS_CF;
 }
 void deviceConnectCpuSetPF() {
+    vcpuinsSyncFlags();
     _SetEFLAGS_PF;
 }
 void deviceConnectCpuSetAF() {
+    vcpuinsSyncFlags();
     _SetEFLAGS_AF;
 }
 void deviceConnectCpuSetZF() {
+    vcpuinsSyncFlags();
     _SetEFLAGS_ZF;
 }
 void deviceConnectCpuSetSF() {
+    vcpuinsSyncFlags();
     _SetEFLAGS_SF;
 }
 void deviceConnectCpuSetTF() {
@@ -206,6 +224,7 @@ void deviceConnectCpuSetDF() {
     _SetEFLAGS_DF;
 }
 void deviceConnectCpuSetOF() {
+    vcpuinsSyncFlags();
     _SetEFLAGS_OF;
 }
 void deviceConnectCpuSetNT() {
@@ -219,18 +238,23 @@ void deviceConnectCpuSetVM() {
 }
 
 void deviceConnectCpuClearCF() {
+    vcpuinsSyncFlags();
     _ClrEFLAGS_CF;
 }
 void deviceConnectCpuClearPF() {
+    vcpuinsSyncFlags();
     _ClrEFLAGS_PF;
 }
 void deviceConnectCpuClearAF() {
+    vcpuinsSyncFlags();
     _ClrEFLAGS_AF;
 }
 void deviceConnectCpuClearZF() {
+    vcpuinsSyncFlags();
     _ClrEFLAGS_ZF;
 }
 void deviceConnectCpuClearSF() {
+    vcpuinsSyncFlags();
     _ClrEFLAGS_SF;
 }
 void deviceConnectCpuClearTF() {
@@ -243,6 +267,7 @@ void deviceConnectCpuClearDF() {
     _ClrEFLAGS_DF;
 }
 void deviceConnectCpuClearOF() {
+    vcpuinsSyncFlags();
     _ClrEFLAGS_OF;
 }
 void deviceConnectCpuClearNT() {
@@ -280,6 +305,7 @@ void *deviceConnectCpuGetRefEDI() {
     return (void *)(&vcpu.data.edi);
 }
 void *deviceConnectCpuGetRefEFLAGS() {
+    vcpuinsSyncFlags();
     return (void *)(&vcpu.data.eflags);
 }
 void *deviceConnectCpuGetRefEIP() {
@@ -324,6 +350,7 @@ void *deviceConnectCpuGetRefDI() {
     return (void *)(&vcpu.data.di);
 }
 void *deviceConnectCpuGetRefFLAGS() {
+    vcpuinsSyncFlags();
     return (void *)(&vcpu.data.flags);
 }
 void *deviceConnectCpuGetRefIP() {
@@ -426,6 +453,7 @@ void devicePrintCpuCreg() {
 }
 /* Prints regular registers */
 void devicePrintCpuReg() {
+    vcpuinsSyncFlags();
     PRINTF( "EAX=%08X", vcpu.data.eax);
     PRINTF(" EBX=%08X", vcpu.data.ebx);
     PRINTF(" ECX=%08X", vcpu.data.ecx);
@@ -461,6 +489,27 @@ void devicePrintCpuMem() {
                vcpuins.data.mem[i].linear, vcpuins.data.mem[i].data, vcpuins.data.mem[i].byte);
     }
 }
+void devicePrintCpuStat() {
+    PRINTF("Fetch Cache: %llu hits, %llu misses, %llu flushes\n",
+           (unsigned long long) vcpuins.data.fcacheHit,
+           (unsigned long long) vcpuins.data.fcacheMiss,
+           (unsigned long long) vcpuins.data.fcacheFlush);
+    PRINTF("TLB: %llu hits, %llu misses, %llu flushes\n",
+           (unsigned long long) vcpuins.data.tlbHit,
+           (unsigned long long) vcpuins.data.tlbMiss,
+           (unsigned long long) vcpuins.data.tlbFlush);
+    PRINTF("Descriptor Cache: %llu hits, %llu misses\n",
+           (unsigned long long) vcpuins.data.xcacheHit,
+           (unsigned long long) vcpuins.data.xcacheMiss);
+    PRINTF("Fused Branches: %llu\n", (unsigned long long) vcpuins.data.fuseIns);
+    PRINTF("JIT: %s, %llu blocks, %llu links, %llu runs, %llu instructions, %llu flushes\n",
+           vcpuins.connect.flagJit ? "on" : "off",
+           (unsigned long long) vcpuins.data.jitBlock,
+           (unsigned long long) vcpuins.data.jitChain,
+           (unsigned long long) vcpuins.data.jitExec,
+           (unsigned long long) vcpuins.data.jitIns,
+           (unsigned long long) vcpuins.data.jitFlush);
+}
 void devicePrintCpuWatch() {
     if (vcpuins.data.flagWR) {
         PRINTF("Watch-read point: Lin=%08x\n", vcpuins.data.wrLinear);
@@ -52,8 +52,29 @@ typedef struct {
             t_nubit4 type;
         } sys;
     };
+    /* host pointer window, computed when the register is loaded */
+    t_bool hostRead, hostWrite;
+    t_nubit32 hostMode; /* cpu mode the window is valid for */
+    t_nubit32 hostLower, hostUpper; /* offsets that map directly into vram */
+    t_vaddrcc hostBase; /* host address of offset 0 */
+    /* access checks, computed when the register is loaded */
+    t_nubit8 accPerm; /* accesses that pass the type checks, VCPU_SREG_ACC_* */
+    t_nubit32 accMode; /* cpu mode the checks are valid for */
+    t_nubit32 accLower, accSpan; /* offsets from lower to lower + span pass the limit check */
+    t_bool accFlat; /* base 0 and limits 0 to 4G-1 */
 } t_cpu_data_sreg;
 
+#define VCPU_SREG_ACC_READ  0x01
+#define VCPU_SREG_ACC_WRITE 0x02
+#define VCPU_SREG_ACC_FORCE 0x04 /* privileged access of the emulator itself */
+
+typedef struct {
+    t_nubit32 flags; /* status flags not yet materialized in eflags */
+    t_nubit32 type, bit;
+    t_bool cf; /* carry-in of adc and sbb */
+    t_nubit64 opr1, opr2, result;
+} t_cpu_data_lazy;
+
 typedef struct {
     /* general registers */
     union {
@@ -125,6 +146,8 @@ typedef struct {
     t_nubit32 tr0, tr1, tr2, tr3, tr4, tr5, tr6, tr7;
     /* control flags */
     t_bool flagMaskNMI, flagNMI, flagHalt;
+    /* last arithmetic operation */
+    t_cpu_data_lazy lazy;
 } t_cpu_data;
 
 typedef struct {
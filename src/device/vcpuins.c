@@ -2,6 +2,31 @@
 
 /* DEBUGGING OPTIONS ******************************************************* */
 #define i386(n) if (1)
+/* computes status flags eagerly and verifies each lazy evaluation */
+#define VCPUINS_LAZY_CHECK 0
+/* verifies the modrm, sib and register tables against a plain decoding */
+#define VCPUINS_MODRM_CHECK 0
+/* dispatches by computed goto with one-pass prefix decoding (gcc/clang) */
+#ifndef VCPUINS_DISPATCH_GOTO
+#define VCPUINS_DISPATCH_GOTO 0
+#endif
+#if VCPUINS_DISPATCH_GOTO == 1 && !defined(__GNUC__)
+#undef VCPUINS_DISPATCH_GOTO
+#define VCPUINS_DISPATCH_GOTO 0
+#endif
+/* translates hot register-only blocks into host code (x86-64 linux) */
+#ifndef VCPUINS_JIT
+#if defined(__x86_64__) && defined(__linux__)
+#define VCPUINS_JIT 1
+#else
+#define VCPUINS_JIT 0
+#endif
+#endif
+/* raises exceptions by a long jump to the innermost fault frame, so helper
+   calls need no exception check on return (not with the code tracer) */
+#ifndef VCPUINS_FAULT_JUMP
+#define VCPUINS_FAULT_JUMP 1
+#endif
 /* ************************************************************************* */
 
 #include "../utils.h"
@@ -10,6 +35,8 @@
 #include "vport.h"
 #include "vram.h"
 #include "vpic.h"
+#include "vdebug.h"
+#include "vmachine.h"
 
 #include "vcpuins.h"
 
@@ -21,6 +48,38 @@ t_cpuins vcpuins;
 
 static t_utils_trace UTILS_TRACE_VAR;
 
+#if UTILS_TRACE_ENABLED == 1 || VCPUINS_TRACE == 1
+#undef VCPUINS_FAULT_JUMP
+#define VCPUINS_FAULT_JUMP 0
+#endif
+#if VCPUINS_FAULT_JUMP == 1
+/* a raised exception never returns here, so calls are straight-line code */
+#undef _chb
+#undef _chr
+#undef _chrz
+#define _chb(n) if (1) {(n);} else
+#define _chr(n) do {(n);} while (0)
+#define _chrz(n) do {(n);} while (0)
+/* a fault raised outside every frame cannot unwind: stops the machine */
+static void _kfj_lost() {
+    SetBit(vcpuins.data.except, VCPUINS_EXCEPT_CE);
+    PRINTF("#CE(%x) - fault raised without a fault frame\n", vcpuins.data.excode);
+    deviceStop();
+}
+/* unwinds to the innermost fault frame */
+#define _kfj_raise() (vcpuins.data.rfault ? longjmp(*vcpuins.data.rfault, 1) : _kfj_lost())
+/* runs a statement block under its own fault frame */
+#define _kfj_try { \
+    jmp_buf kfjFrame, *kfjPrev = vcpuins.data.rfault; \
+    vcpuins.data.rfault = &kfjFrame; \
+    if (!setjmp(kfjFrame)) {
+#define _kfj_end } vcpuins.data.rfault = kfjPrev; }
+#else
+#define _kfj_raise() ((void) 0)
+#define _kfj_try {
+#define _kfj_end }
+#endif
+
 /* indicates functions not implemented */
 #define _______todo static void
 /* prints untested code path */
@@ -33,17 +92,167 @@ PRINTF("NEW CODE PATH\n");utilsTracePrint(&(UTILS_TRACE_VAR));} while (0)
 #define _GetOperandSize ((vcpu.data.cs.seg.exec.defsize ^ vcpuins.data.prefix_oprsize) ? 4 : 2)
 /* address size of the source operand */
 #define _GetAddressSize ((vcpu.data.cs.seg.exec.defsize ^ vcpuins.data.prefix_addrsize) ? 4 : 2)
+
+/* cpu mode bits that a segment host pointer window depends on */
+#define _GetHostMode ((vcpu.data.cr0 & (VCPU_CR0_PE | VCPU_CR0_PG)) | \
+    (vcpu.data.eflags & VCPU_EFLAGS_VM) | (vram.data.flagA20 ? VRAM_BIT_A20 : 0))
+/* cpu mode bits that the segment access checks depend on */
+#define _GetAccessMode ((vcpu.data.cr0 & VCPU_CR0_PE) | (vcpu.data.eflags & VCPU_EFLAGS_VM))
+/* access permission bit to look up in the segment access checks */
+#define _GetAccessPerm(write, force) ((force) ? VCPU_SREG_ACC_FORCE : \
+    ((write) ? VCPU_SREG_ACC_WRITE : VCPU_SREG_ACC_READ))
+/* if access lies entirely in the host pointer window */
+#define _IsHostWindow(rsreg, offset, byte) ((rsreg)->hostMode == _GetHostMode && \
+    (offset) >= (rsreg)->hostLower && (offset) <= (rsreg)->hostUpper && \
+    (rsreg)->hostUpper - (offset) >= (t_nubit32)((byte) - 1))
+
+/* status flags of the last arithmetic operation are evaluated on demand */
+static void _kaf_sync(t_nubit32 flags);
+#define _LazyGet(flag) (_kaf_sync(flag), GetBit(vcpu.data.eflags, (flag)))
+#define _LazySet(flag) (ClrBit(vcpu.data.lazy.flags, (flag)), SetBit(vcpu.data.eflags, (flag)))
+#define _LazyClr(flag) (ClrBit(vcpu.data.lazy.flags, (flag)), ClrBit(vcpu.data.eflags, (flag)))
+#undef _GetEFLAGS_CF
+#undef _GetEFLAGS_PF
+#undef _GetEFLAGS_AF
+#undef _GetEFLAGS_ZF
+#undef _GetEFLAGS_SF
+#undef _GetEFLAGS_OF
+#undef _SetEFLAGS_CF
+#undef _SetEFLAGS_PF
+#undef _SetEFLAGS_AF
+#undef _SetEFLAGS_ZF
+#undef _SetEFLAGS_SF
+#undef _SetEFLAGS_OF
+#undef _ClrEFLAGS_CF
+#undef _ClrEFLAGS_PF
+#undef _ClrEFLAGS_AF
+#undef _ClrEFLAGS_ZF
+#undef _ClrEFLAGS_SF
+#undef _ClrEFLAGS_OF
+#define _GetEFLAGS_CF (_LazyGet(VCPU_EFLAGS_CF))
+#define _GetEFLAGS_PF (_LazyGet(VCPU_EFLAGS_PF))
+#define _GetEFLAGS_AF (_LazyGet(VCPU_EFLAGS_AF))
+#define _GetEFLAGS_ZF (_LazyGet(VCPU_EFLAGS_ZF))
+#define _GetEFLAGS_SF (_LazyGet(VCPU_EFLAGS_SF))
+#define _GetEFLAGS_OF (_LazyGet(VCPU_EFLAGS_OF))
+#define _SetEFLAGS_CF (_LazySet(VCPU_EFLAGS_CF))
+#define _SetEFLAGS_PF (_LazySet(VCPU_EFLAGS_PF))
+#define _SetEFLAGS_AF (_LazySet(VCPU_EFLAGS_AF))
+#define _SetEFLAGS_ZF (_LazySet(VCPU_EFLAGS_ZF))
+#define _SetEFLAGS_SF (_LazySet(VCPU_EFLAGS_SF))
+#define _SetEFLAGS_OF (_LazySet(VCPU_EFLAGS_OF))
+#define _ClrEFLAGS_CF (_LazyClr(VCPU_EFLAGS_CF))
+#define _ClrEFLAGS_PF (_LazyClr(VCPU_EFLAGS_PF))
+#define _ClrEFLAGS_AF (_LazyClr(VCPU_EFLAGS_AF))
+#define _ClrEFLAGS_ZF (_LazyClr(VCPU_EFLAGS_ZF))
+#define _ClrEFLAGS_SF (_LazyClr(VCPU_EFLAGS_SF))
+#define _ClrEFLAGS_OF (_LazyClr(VCPU_EFLAGS_OF))
 /* if opcode indicates a prefix */
-#define _SetExcept_DE(n) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_DE), vcpuins.data.excode = (n), PRINTF("#DE(%x) - divide error\n",    vcpuins.data.excode))
-#define _SetExcept_PF(n) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_PF), vcpuins.data.excode = (n), PRINTF("#PF(%x) - page fault\n",      vcpuins.data.excode))
-#define _SetExcept_GP(n) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_GP), vcpuins.data.excode = (n), PRINTF("#GP(%x) - general protect\n", vcpuins.data.excode))
-#define _SetExcept_SS(n) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_SS), vcpuins.data.excode = (n), PRINTF("#SS(%x) - stack segment\n",   vcpuins.data.excode))
-#define _SetExcept_UD(n) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_UD), vcpuins.data.excode = (n), PRINTF("#UD(%x) - undefined\n",       vcpuins.data.excode))
-#define _SetExcept_NP(n) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_NP), vcpuins.data.excode = (n), PRINTF("#NP(%x) - not present\n",     vcpuins.data.excode))
-#define _SetExcept_BR(n) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_BR), vcpuins.data.excode = (n), PRINTF("#BR(%x) - boundary\n",        vcpuins.data.excode))
-#define _SetExcept_TS(n) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_TS), vcpuins.data.excode = (n), PRINTF("#TS(%x) - task state\n",      vcpuins.data.excode))
-#define _SetExcept_NM(n) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_NM), vcpuins.data.excode = (n), PRINTF("#NM(%x) - divide error\n",    vcpuins.data.excode))
-#define _SetExcept_CE(n) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_CE), vcpuins.data.excode = (n), PRINTF("#CE(%x) - internal error\n",  vcpuins.data.excode))
+#define _SetExcept_DE(n) ((void) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_DE), vcpuins.data.excode = (n), PRINTF("#DE(%x) - divide error\n",    vcpuins.data.excode), _kfj_raise()))
+#define _SetExcept_PF(n) ((void) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_PF), vcpuins.data.excode = (n), PRINTF("#PF(%x) - page fault\n",      vcpuins.data.excode), _kfj_raise()))
+#define _SetExcept_GP(n) ((void) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_GP), vcpuins.data.excode = (n), PRINTF("#GP(%x) - general protect\n", vcpuins.data.excode), _kfj_raise()))
+#define _SetExcept_SS(n) ((void) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_SS), vcpuins.data.excode = (n), PRINTF("#SS(%x) - stack segment\n",   vcpuins.data.excode), _kfj_raise()))
+#define _SetExcept_UD(n) ((void) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_UD), vcpuins.data.excode = (n), PRINTF("#UD(%x) - undefined\n",       vcpuins.data.excode), _kfj_raise()))
+#define _SetExcept_NP(n) ((void) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_NP), vcpuins.data.excode = (n), PRINTF("#NP(%x) - not present\n",     vcpuins.data.excode), _kfj_raise()))
+#define _SetExcept_BR(n) ((void) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_BR), vcpuins.data.excode = (n), PRINTF("#BR(%x) - boundary\n",        vcpuins.data.excode), _kfj_raise()))
+#define _SetExcept_TS(n) ((void) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_TS), vcpuins.data.excode = (n), PRINTF("#TS(%x) - task state\n",      vcpuins.data.excode), _kfj_raise()))
+#define _SetExcept_NM(n) ((void) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_NM), vcpuins.data.excode = (n), PRINTF("#NM(%x) - divide error\n",    vcpuins.data.excode), _kfj_raise()))
+#define _SetExcept_CE(n) ((void) (SetBit(vcpuins.data.except, VCPUINS_EXCEPT_CE), vcpuins.data.excode = (n), PRINTF("#CE(%x) - internal error\n",  vcpuins.data.excode), _kfj_raise()))
+
+/* undo log */
+/* starts a new log for the current instruction */
+static void _kul_init() {
+    vcpuins.data.undo.eax = vcpu.data.eax;
+    vcpuins.data.undo.ecx = vcpu.data.ecx;
+    vcpuins.data.undo.edx = vcpu.data.edx;
+    vcpuins.data.undo.ebx = vcpu.data.ebx;
+    vcpuins.data.undo.esp = vcpu.data.esp;
+    vcpuins.data.undo.ebp = vcpu.data.ebp;
+    vcpuins.data.undo.esi = vcpu.data.esi;
+    vcpuins.data.undo.edi = vcpu.data.edi;
+    vcpuins.data.undo.eip = vcpu.data.eip;
+    vcpuins.data.undo.eflags = vcpu.data.eflags;
+    vcpuins.data.undo.flagMaskNMI = vcpu.data.flagMaskNMI;
+    vcpuins.data.undo.flagNMI = vcpu.data.flagNMI;
+    vcpuins.data.undo.flagHalt = vcpu.data.flagHalt;
+    vcpuins.data.undo.lazy = vcpu.data.lazy;
+    vcpuins.data.undo.nsreg = 0;
+    vcpuins.data.undo.nreg = 0;
+}
+/* saves segment register before its first modification */
+static void _kul_save_sreg(t_cpu_data_sreg *rsreg) {
+    t_nubit8 i;
+    if ((t_vaddrcc)rsreg < (t_vaddrcc)&vcpu ||
+            (t_vaddrcc)rsreg >= (t_vaddrcc)&vcpu + sizeof(t_cpu)) {
+        /* temporary descriptor, not part of cpu state */
+        return;
+    }
+    for (i = 0; i < vcpuins.data.undo.nsreg; ++i) {
+        if (vcpuins.data.undo.rsreg[i] == rsreg) return;
+    }
+    if (i == VCPUINS_UNDO_SREG) {
+        _SetExcept_CE(i);
+        return;
+    }
+    vcpuins.data.undo.rsreg[i] = rsreg;
+    vcpuins.data.undo.sreg[i] = *rsreg;
+    vcpuins.data.undo.nsreg++;
+}
+/* saves control, debug or test register before its first modification */
+static void _kul_save_reg(t_nubit32 *rreg) {
+    t_nubit8 i;
+    for (i = 0; i < vcpuins.data.undo.nreg; ++i) {
+        if (vcpuins.data.undo.rreg[i] == rreg) return;
+    }
+    if (i == VCPUINS_UNDO_REG) {
+        _SetExcept_CE(i);
+        return;
+    }
+    vcpuins.data.undo.rreg[i] = rreg;
+    vcpuins.data.undo.reg[i] = *rreg;
+    vcpuins.data.undo.nreg++;
+}
+/* restores segment register if it is modified */
+static void _kul_restore_sreg(t_cpu_data_sreg *rsreg) {
+    t_nubit8 i;
+    for (i = 0; i < vcpuins.data.undo.nsreg; ++i) {
+        if (vcpuins.data.undo.rsreg[i] == rsreg) {
+            *rsreg = vcpuins.data.undo.sreg[i];
+            return;
+        }
+    }
+}
+/* restores cpu state at the beginning of the log */
+static void _kul_rollback() {
+    t_nubit8 i;
+    vcpu.data.eax = vcpuins.data.undo.eax;
+    vcpu.data.ecx = vcpuins.data.undo.ecx;
+    vcpu.data.edx = vcpuins.data.undo.edx;
+    vcpu.data.ebx = vcpuins.data.undo.ebx;
+    vcpu.data.esp = vcpuins.data.undo.esp;
+    vcpu.data.ebp = vcpuins.data.undo.ebp;
+    vcpu.data.esi = vcpuins.data.undo.esi;
+    vcpu.data.edi = vcpuins.data.undo.edi;
+    vcpu.data.eip = vcpuins.data.undo.eip;
+    vcpu.data.eflags = vcpuins.data.undo.eflags;
+    vcpu.data.flagMaskNMI = vcpuins.data.undo.flagMaskNMI;
+    vcpu.data.flagNMI = vcpuins.data.undo.flagNMI;
+    vcpu.data.flagHalt = vcpuins.data.undo.flagHalt;
+    vcpu.data.lazy = vcpuins.data.undo.lazy;
+    for (i = 0; i < vcpuins.data.undo.nsreg; ++i) {
+        *(vcpuins.data.undo.rsreg[i]) = vcpuins.data.undo.sreg[i];
+    }
+    for (i = 0; i < vcpuins.data.undo.nreg; ++i) {
+        *(vcpuins.data.undo.rreg[i]) = vcpuins.data.undo.reg[i];
+    }
+}
+
+/* commits completed iterations of a repeated string instruction */
+static void _kul_commit() {
+    t_nubit32 eip = vcpuins.data.undo.eip;
+    _kul_init();
+    vcpuins.data.undo.eip = eip;
+}
 
 /* memory management unit */
 /* kernel memory accessing */
@@ -71,20 +280,42 @@ static void _kma_write_physical(t_nubit32 physical, t_vaddrcc rdata, t_nubit8 by
     _chr(vramWritePhysical(physical, rdata, byte));
     _ce;
 }
+/* invalidate all tlb entries */
+static void _kma_flush_tlb() {
+    t_nubitcc i;
+    for (i = 0; i < VCPUINS_TLB_SIZE; ++i) {
+        vcpuins.data.tlb[i].flagValid = False;
+    }
+    vcpuins.data.tlbFlush++;
+}
 /* translate linear to physical - paging mechanism*/
 static t_nubit32 _kma_physical_linear(t_nubit32 linear, t_nubit8 byte, t_bool write, t_nubit8 vpl) {
     t_nubit32 ppde, ppte; /* page table entries */
-    t_nubit32 cpde, cpte;
+    t_nubit32 cpde, cpte, npde, npte;
+    t_cpuins_data_tlb *rentry;
     _cb("_t_kma_physical_linear");
     if (_GetLinear_Offset(linear) > GetMax32(_GetPageSize - byte)) _impossible_rz_;
     if (!_IsPaging) {
         _ce;
         return linear;
     }
+    rentry = &vcpuins.data.tlb[(linear >> 12) % VCPUINS_TLB_SIZE];
+    if (rentry->flagValid && rentry->linear == (linear & ~VCPU_LINEAR_OFFSET) &&
+            rentry->flagA20 == vram.data.flagA20 &&
+            rentry->verpde == VRAM_GetVersion(rentry->ppde) &&
+            rentry->verpte == VRAM_GetVersion(rentry->ppte) &&
+            (vpl != 0x03 || (rentry->flagUser && (!write || rentry->flagWrite))) &&
+            (!write || rentry->flagDirty)) {
+        vcpuins.data.tlbHit++;
+        _ce;
+        return (rentry->physical + _GetLinear_Offset(linear));
+    }
+    vcpuins.data.tlbMiss++;
     ppde = _GetCR3_Base + _GetLinear_Dir(linear) * 4;
     _chrz(_kma_read_physical(ppde, GetRef(cpde), 4));
     if (!_IsPageEntryPresent(cpde)) {
         _bb("!PageDirEntryPresent");
+        _kul_save_reg(&vcpu.data.cr2);
         vcpu.data.cr2 = linear;
         _chrz(_SetExcept_PF(_MakePageFaultErrorCode(0, write, (vpl == 3))));
         _be;
@@ -93,24 +324,30 @@ static t_nubit32 _kma_physical_linear(t_nubit32 linear, t_nubit8 byte, t_bool wr
         _bb("vpl(3)");
         if (!_GetPageEntry_US(cpde)) {
             _bb("PageDirEntry_US(0)");
+            _kul_save_reg(&vcpu.data.cr2);
             vcpu.data.cr2 = linear;
             _chrz(_SetExcept_PF(_MakePageFaultErrorCode(1, write, 1)));
             _be;
         }
         if (write && !_IsPageEntryWritable(cpde)) {
             _bb("write,!PageDirEntryWritable");
+            _kul_save_reg(&vcpu.data.cr2);
             vcpu.data.cr2 = linear;
             _chrz(_SetExcept_PF(_MakePageFaultErrorCode(1, 1, 1)));
             _be;
         }
         _be;
     }
-    _SetPageEntry_A(cpde);
-    _chrz(_kma_write_physical(ppde, GetRef(cpde), 4));
+    npde = cpde;
+    _SetPageEntry_A(npde);
+    if (npde != cpde) {
+        _chrz(_kma_write_physical(ppde, GetRef(npde), 4));
+    }
     ppte = _GetPageEntry_Base(cpde) + _GetLinear_Page(linear) * 4;
     _chrz(_kma_read_physical(ppte, GetRef(cpte), 4));
     if (!_IsPageEntryPresent(cpte)) {
         _bb("!PageTabEntryPresent");
+        _kul_save_reg(&vcpu.data.cr2);
         vcpu.data.cr2 = linear;
         _chrz(_SetExcept_PF(_MakePageFaultErrorCode(0, write, (vpl == 3))));
         _be;
@@ -119,28 +356,53 @@ static t_nubit32 _kma_physical_linear(t_nubit32 linear, t_nubit8 byte, t_bool wr
         _bb("vpl(3)");
         if (!_GetPageEntry_US(cpte)) {
             _bb("PageTabEntry_US(0)");
+            _kul_save_reg(&vcpu.data.cr2);
             vcpu.data.cr2 = linear;
             _chrz(_SetExcept_PF(_MakePageFaultErrorCode(1, write, 1)));
             _be;
         }
         if (write && !_IsPageEntryWritable(cpte)) {
             _bb("write,!PageTabEntryWritable");
+            _kul_save_reg(&vcpu.data.cr2);
             vcpu.data.cr2 = linear;
             _chrz(_SetExcept_PF(_MakePageFaultErrorCode(1, 1, 1)));
             _be;
         }
         _be;
     }
-    _SetPageEntry_A(cpte);
-    if (write) _SetPageEntry_D(cpte);
-    _chrz(_kma_write_physical(ppte, GetRef(cpte), 4));
+    npte = cpte;
+    _SetPageEntry_A(npte);
+    if (write) _SetPageEntry_D(npte);
+    if (npte != cpte) {
+        _chrz(_kma_write_physical(ppte, GetRef(npte), 4));
+    }
+    /* versions are taken after accessed/dirty bits are written back */
+    rentry->flagValid = True;
+    rentry->flagA20 = vram.data.flagA20;
+    rentry->flagUser = _GetPageEntry_US(cpde) && _GetPageEntry_US(cpte);
+    rentry->flagWrite = _IsPageEntryWritable(cpde) && _IsPageEntryWritable(cpte);
+    rentry->flagDirty = _GetPageEntry_D(npte);
+    rentry->linear = linear & ~VCPU_LINEAR_OFFSET;
+    rentry->physical = _GetPageEntry_Base(cpte);
+    rentry->ppde = ppde;
+    rentry->ppte = ppte;
+    rentry->verpde = VRAM_GetVersion(ppde);
+    rentry->verpte = VRAM_GetVersion(ppte);
     _ce;
     return (_GetPageEntry_Base(cpte) + _GetLinear_Offset(linear));
 }
+static void _ksa_load_access(t_cpu_data_sreg *rsreg);
 /* translate logical to linear - segmentation mechanism */
 static t_nubit32 _kma_linear_logical(t_cpu_data_sreg *rsreg, t_nubit32 offset, t_nubit8 byte, t_bool write, t_nubit8 vpl, t_bool force) {
     t_nubit32 linear;
     t_nubit32 upper, lower;
+    if (rsreg->accMode == _GetAccessMode && GetBit(rsreg->accPerm, _GetAccessPerm(write, force))) {
+        if (rsreg->accFlat) {
+            if (offset <= GetMax32(Max32 - (byte - 1))) return offset;
+        } else if (GetMax32(offset - rsreg->accLower) <= rsreg->accSpan - (byte - 1)) {
+            return rsreg->base + offset;
+        }
+    }
     _cb("_kma_linear_logical");
     switch (rsreg->sregtype) {
     case SREG_CODE:
@@ -292,6 +554,8 @@ static t_nubit32 _kma_linear_logical(t_cpu_data_sreg *rsreg, t_nubit32 offset, t
         }
         _be;
     }
+    /* registers set up outside _ksa_load_sreg pick up their checks here */
+    if (!rsreg->accPerm || rsreg->accMode != _GetAccessMode) _ksa_load_access(rsreg);
     _ce;
     return linear;
 }
@@ -341,13 +605,52 @@ static void _kma_write_linear(t_nubit32 linear, t_vaddrcc rdata, t_nubit8 byte,
     }
     _ce;
 }
+/* read content from host memory */
+static void _kma_read_host(t_vaddrcc host, t_vaddrcc rdata, t_nubit8 byte) {
+    switch (byte) {
+    case 1:
+        d_nubit8(rdata) = d_nubit8(host);
+        break;
+    case 2:
+        d_nubit16(rdata) = d_nubit16(host);
+        break;
+    case 4:
+        d_nubit32(rdata) = d_nubit32(host);
+        break;
+    default:
+        MEMCPY((void *) rdata, (void *) host, byte);
+        break;
+    }
+}
+/* write content to host memory */
+static void _kma_write_host(t_vaddrcc host, t_vaddrcc rdata, t_nubit8 byte) {
+    switch (byte) {
+    case 1:
+        d_nubit8(host) = d_nubit8(rdata);
+        break;
+    case 2:
+        d_nubit16(host) = d_nubit16(rdata);
+        break;
+    case 4:
+        d_nubit32(host) = d_nubit32(rdata);
+        break;
+    default:
+        MEMCPY((void *) host, (void *) rdata, byte);
+        break;
+    }
+}
 /* read content from logical */
 static void _kma_read_logical(t_cpu_data_sreg *rsreg, t_nubit32 offset, t_vaddrcc rdata, t_nubit8 byte, t_nubit8 vpl, t_bool force) {
     /* t_nubitcc i; */
     t_nubit32 linear;
     _cb("_kma_read_logical");
-    _chr(linear = _kma_linear_logical(rsreg, offset, byte, 0, vpl, force));
-    _chr(_kma_read_linear(linear, rdata, byte, vpl, force));
+    if (rsreg->hostRead && _IsHostWindow(rsreg, offset, byte)) {
+        linear = rsreg->base + offset;
+        _kma_read_host(rsreg->hostBase + offset, rdata, byte);
+    } else {
+        _chr(linear = _kma_linear_logical(rsreg, offset, byte, 0, vpl, force));
+        _chr(_kma_read_linear(linear, rdata, byte, vpl, force));
+    }
     if (!force) {
         _bb("!force");
         vcpuins.data.mem[vcpuins.data.msize].flagWrite = False;
@@ -383,8 +686,16 @@ static void _kma_write_logical(t_cpu_data_sreg *rsreg, t_nubit32 offset, t_vaddr
     /* t_nubitcc i; */
     t_nubit32 linear;
     _cb("_kma_write_logical");
-    _chr(linear = _kma_linear_logical(rsreg, offset, byte, 1, vpl, force));
-    _chr(_kma_write_linear(linear, rdata, byte, vpl, force));
+    if (rsreg->hostWrite && _IsHostWindow(rsreg, offset, byte)) {
+        linear = rsreg->base + offset;
+        _kma_write_host(rsreg->hostBase + offset, rdata, byte);
+        vramMarkPhysical(linear, byte);
+    } else {
+        _chr(linear = _kma_linear_logical(rsreg, offset, byte, 1, vpl, force));
+        _chr(_kma_write_linear(linear, rdata, byte, vpl, force));
+    }
+    vmachineWatchWrite(linear, (byte >= 4) ? d_nubit32(rdata) :
+                       ((byte == 2) ? d_nubit16(rdata) : d_nubit8(rdata)));
     if (!force) {
         _bb("!force");
         vcpuins.data.mem[vcpuins.data.msize].flagWrite = True;
@@ -552,9 +863,49 @@ static void _ksa_read_gdt(t_nubit16 selector, t_vaddrcc rdata) {
     _chr(_kma_read_logical(&vcpu.data.gdtr, _GetSelector_Offset(selector), rdata, 8, 0x00, 1));
     _ce;
 }
+/* translates the descriptor of selector into physical addresses of both pages */
+static void _ksa_xcache_locate(t_cpu_data_sreg *rtable, t_nubit16 selector,
+                               t_nubit32 *rphy1, t_nubit32 *rphy2) {
+    t_nubit32 linear = rtable->base + _GetSelector_Offset(selector);
+    t_nubit8 byte1 = 8;
+    _cb("_ksa_xcache_locate");
+    if (_GetLinear_Offset(linear) > GetMax32(_GetPageSize - 8))
+        byte1 = _GetPageSize - _GetLinear_Offset(linear);
+    _chr(*rphy1 = _kma_physical_linear(linear, byte1, 0, 0x00));
+    *rphy2 = *rphy1;
+    if (byte1 < 8) {
+        _chr(*rphy2 = _kma_physical_linear(linear + byte1, 8 - byte1, 0, 0x00));
+    }
+    _ce;
+}
 static void _ksa_read_xdt(t_nubit16 selector, t_vaddrcc rdata) {
+    t_nubit32 phy1, phy2;
+    t_cpu_data_sreg *rtable;
+    t_cpuins_data_desc *rentry;
     _cb("_ksa_read_xdt");
     if (!_GetCR0_PE) _impossible_r_;
+    /* raw descriptors are cached by selector, tagged by the table they are
+       read from and by the versions of the pages holding them; a hit still
+       translates the descriptor address, since the page tables may have
+       changed, and only saves the limit check and the memory read */
+    rtable = _GetSelector_TI(selector) ? &vcpu.data.ldtr : &vcpu.data.gdtr;
+    rentry = &vcpuins.data.xcache[(GetMax16(selector) >> 3) % VCPUINS_XCACHE_SIZE];
+    if (rentry->flagValid && rentry->selector == (selector & ~VCPU_SELECTOR_RPL) &&
+            rentry->tbase == rtable->base && rentry->tlimit == rtable->limit &&
+            rentry->flagA20 == vram.data.flagA20 && rtable->flagValid &&
+            !(_GetSelector_TI(selector) && _IsSelectorNull(rtable->selector))) {
+        _chr(_ksa_xcache_locate(rtable, selector, &phy1, &phy2));
+        if (rentry->phy1 == phy1 && rentry->phy2 == phy2 &&
+                rentry->ver1 == VRAM_GetVersion(phy1) &&
+                rentry->ver2 == VRAM_GetVersion(phy2)) {
+            vcpuins.data.xcacheHit++;
+            MEMCPY((void *) rdata, (void *) GetRef(rentry->descriptor), 8);
+            _ce;
+            return;
+        }
+    }
+    vcpuins.data.xcacheMiss++;
+    rentry->flagValid = False;
     if (_GetSelector_TI(selector)) {
         _bb("Selector_TI");
         _chr(_ksa_read_ldt(selector, rdata));
@@ -564,6 +915,15 @@ static void _ksa_read_xdt(t_nubit16 selector, t_vaddrcc rdata) {
         _chr(_ksa_read_gdt(selector, rdata));
         _be;
     }
+    _chr(_ksa_xcache_locate(rtable, selector, &rentry->phy1, &rentry->phy2));
+    rentry->ver1 = VRAM_GetVersion(rentry->phy1);
+    rentry->ver2 = VRAM_GetVersion(rentry->phy2);
+    rentry->selector = selector & ~VCPU_SELECTOR_RPL;
+    rentry->tbase = rtable->base;
+    rentry->tlimit = rtable->limit;
+    rentry->flagA20 = vram.data.flagA20;
+    MEMCPY((void *) GetRef(rentry->descriptor), (void *) rdata, 8);
+    rentry->flagValid = True;
     _ce;
 }
 static void _ksa_write_ldt(t_nubit16 selector, t_vaddrcc rdata) {
@@ -598,9 +958,120 @@ static void _ksa_write_xdt(t_nubit16 selector, t_vaddrcc rdata) {
     }
     _ce;
 }
+/* compute host pointer window of segment register */
+static void _ksa_load_window(t_cpu_data_sreg *rsreg) {
+    t_nubit32 lower, upper;
+    t_nubit64 top;
+    rsreg->hostRead = False;
+    rsreg->hostWrite = False;
+    if (!rsreg->flagValid || _IsPaging) return;
+    switch (rsreg->sregtype) {
+    case SREG_CODE:
+        rsreg->hostRead = !_IsProtected || rsreg->seg.exec.readable;
+        rsreg->hostWrite = !_IsProtected;
+        lower = 0x00000000;
+        upper = rsreg->limit;
+        break;
+    case SREG_STACK:
+    case SREG_DATA:
+        if (_IsProtected) {
+            if (rsreg->sregtype == SREG_STACK &&
+                    (rsreg->seg.executable || !rsreg->seg.data.writable)) return;
+            if (_IsSelectorNull(rsreg->selector)) return;
+            if (rsreg->seg.executable && !rsreg->seg.exec.readable) return;
+            rsreg->hostRead = True;
+            rsreg->hostWrite = !rsreg->seg.executable && rsreg->seg.data.writable;
+        } else {
+            rsreg->hostRead = True;
+            rsreg->hostWrite = True;
+        }
+        if (rsreg->seg.data.expdown) {
+            lower = rsreg->limit + 1;
+            upper = rsreg->seg.data.big ? 0xffffffff : 0x0000ffff;
+        } else {
+            lower = 0x00000000;
+            upper = rsreg->limit;
+        }
+        break;
+    default:
+        return;
+    }
+    /* window must map linearly into vram without a20 wrapping */
+    top = vram.connect.size;
+    if (!vram.data.flagA20 && top > VRAM_BIT_A20) top = VRAM_BIT_A20;
+    if (lower > upper || (t_nubit64) rsreg->base + lower >= top) {
+        rsreg->hostRead = False;
+        rsreg->hostWrite = False;
+        return;
+    }
+    if ((t_nubit64) rsreg->base + upper >= top) {
+        upper = (t_nubit32)(top - 1 - rsreg->base);
+    }
+    rsreg->hostMode = _GetHostMode;
+    rsreg->hostLower = lower;
+    rsreg->hostUpper = upper;
+    rsreg->hostBase = vram.connect.pBase + rsreg->base;
+}
+/* compute access checks of segment register; mirrors _kma_linear_logical */
+static void _ksa_load_access(t_cpu_data_sreg *rsreg) {
+    t_nubit32 lower = 0x00000000, upper = rsreg->limit;
+    rsreg->accMode = _GetAccessMode;
+    rsreg->accPerm = 0;
+    rsreg->accFlat = False;
+    switch (rsreg->sregtype) {
+    case SREG_CODE:
+        if (!rsreg->flagValid) return;
+        rsreg->accPerm = VCPU_SREG_ACC_FORCE;
+        if (!_IsProtected || rsreg->seg.exec.readable) rsreg->accPerm |= VCPU_SREG_ACC_READ;
+        if (!_IsProtected) rsreg->accPerm |= VCPU_SREG_ACC_WRITE;
+        break;
+    case SREG_STACK:
+    case SREG_DATA:
+        if (!rsreg->flagValid) return;
+        if (_IsProtected) {
+            if (rsreg->sregtype == SREG_STACK &&
+                    (rsreg->seg.executable || !rsreg->seg.data.writable)) return;
+            if (_IsSelectorNull(rsreg->selector)) return;
+            if (rsreg->seg.executable && !rsreg->seg.exec.readable) return;
+        }
+        rsreg->accPerm = VCPU_SREG_ACC_FORCE | VCPU_SREG_ACC_READ;
+        if (!_IsProtected || rsreg->sregtype == SREG_STACK ||
+                (!rsreg->seg.executable && rsreg->seg.data.writable))
+            rsreg->accPerm |= VCPU_SREG_ACC_WRITE;
+        if (rsreg->seg.data.expdown) {
+            lower = rsreg->limit + 1;
+            upper = rsreg->seg.data.big ? 0xffffffff : 0x0000ffff;
+        }
+        break;
+    case SREG_LDTR:
+    case SREG_TR:
+        if (!rsreg->flagValid || _IsSelectorNull(rsreg->selector) ||
+                _GetSelector_TI(rsreg->selector)) return;
+        /* fall through */
+    case SREG_GDTR:
+        if (!_GetCR0_PE) return;
+        /* fall through */
+    case SREG_IDTR:
+        rsreg->accPerm = VCPU_SREG_ACC_FORCE | VCPU_SREG_ACC_READ | VCPU_SREG_ACC_WRITE;
+        break;
+    default:
+        return;
+    }
+    /* tiny segments are left to the full check, which handles any access size */
+    if (lower > upper || upper - lower < 0xff) {
+        rsreg->accPerm = 0;
+        return;
+    }
+    rsreg->accLower = lower;
+    rsreg->accSpan = upper - lower;
+    rsreg->accFlat = !rsreg->base && !lower && upper == 0xffffffff;
+}
 static void _ksa_load_sreg(t_cpu_data_sreg *rsreg, t_nubit16 selector) {
     t_nubit64 descriptor;
     _cb("_ksa_load_sreg");
+    _kul_save_sreg(rsreg);
+    rsreg->hostRead = False;
+    rsreg->hostWrite = False;
     switch (rsreg->sregtype) {
     case SREG_CODE:
         /* note: privilege checking not performed */
@@ -623,8 +1094,10 @@ static void _ksa_load_sreg(t_cpu_data_sreg *rsreg, t_nubit16 selector) {
                 _chr(_SetExcept_NP(selector));
                 _be;
             }
-            _SetDescUserAccessed(descriptor);
-            _chr(_ksa_write_xdt(selector, GetRef(descriptor)));
+            if (!_IsDescUserAccessed(descriptor)) {
+                _SetDescUserAccessed(descriptor);
+                _chr(_ksa_write_xdt(selector, GetRef(descriptor)));
+            }
             rsreg->flagValid = True;
             rsreg->base = (t_nubit32)_GetDescSeg_Base(descriptor);
             if (_IsDescCodeNonConform(descriptor))
@@ -683,8 +1156,10 @@ static void _ksa_load_sreg(t_cpu_data_sreg *rsreg, t_nubit16 selector) {
                     _chr(_SetExcept_NP(selector));
                     _be;
                 }
-                _SetDescUserAccessed(descriptor);
-                _chr(_ksa_write_xdt(selector, GetRef(descriptor)));
+                if (!_IsDescUserAccessed(descriptor)) {
+                    _SetDescUserAccessed(descriptor);
+                    _chr(_ksa_write_xdt(selector, GetRef(descriptor)));
+                }
                 rsreg->flagValid = True;
                 rsreg->selector = selector;
                 rsreg->base = (t_nubit32)_GetDescSeg_Base(descriptor);
@@ -748,8 +1223,10 @@ static void _ksa_load_sreg(t_cpu_data_sreg *rsreg, t_nubit16 selector) {
                 _chr(_SetExcept_SS(selector));
                 _be;
             }
-            _SetDescUserAccessed(descriptor);
-            _chr(_ksa_write_xdt(selector, GetRef(descriptor)));
+            if (!_IsDescUserAccessed(descriptor)) {
+                _SetDescUserAccessed(descriptor);
+                _chr(_ksa_write_xdt(selector, GetRef(descriptor)));
+            }
             rsreg->flagValid = True;
             rsreg->selector = selector;
             rsreg->base = (t_nubit32)_GetDescSeg_Base(descriptor);
@@ -847,8 +1324,94 @@ static void _ksa_load_sreg(t_cpu_data_sreg *rsreg, t_nubit16 selector) {
         _impossible_r_;
         break;
     }
+    _ksa_load_window(rsreg);
+    _ksa_load_access(rsreg);
     _ce;
 }
+/* loads code, data or stack segment register in real or virtual-8086 mode */
+static void _ksa_load_sreg_real(t_cpu_data_sreg *rsreg, t_nubit16 selector) {
+    _kul_save_sreg(rsreg);
+    rsreg->flagValid = True;
+    rsreg->selector = selector;
+    rsreg->base = (selector << 4);
+    if (_GetCR0_PE && _GetEFLAGS_VM) {
+        rsreg->dpl = 0x03;
+        rsreg->limit = 0x0000ffff;
+    }
+    _ksa_load_window(rsreg);
+    _ksa_load_access(rsreg);
+}
+
+/* fetch cache */
+/* discards all cached instruction windows */
+static void _kfc_flush() {
+    t_nubitcc i;
+    for (i = 0; i < VCPUINS_FCACHE_SIZE; ++i) {
+        vcpuins.data.fcache[i].flagValid = False;
+    }
+    vcpuins.data.fcacheFlush++;
+}
+/* reads instruction window from linear address into entry */
+static void _kfc_fill(t_cpuins_data_fetch *rentry, t_nubit32 linear) {
+    t_nubit8 byte1, byte2;
+    _cb("_kfc_fill");
+    byte1 = 15;
+    byte2 = 0;
+    if (_GetLinear_Offset(linear) > GetMax32(_GetPageSize - byte1)) {
+        byte1 = _GetPageSize - _GetLinear_Offset(linear);
+        byte2 = 15 - byte1;
+    }
+    _chr(rentry->phy1 = _kma_physical_linear(linear, byte1, 0, 0x00));
+    rentry->phy2 = rentry->phy1;
+    if (byte2) {
+        _chr(rentry->phy2 = _kma_physical_linear(linear + byte1, byte2, 0, 0x00));
+    }
+    _chr(_kma_read_physical(rentry->phy1, (t_vaddrcc) rentry->opcodes, byte1));
+    if (byte2) {
+        _chr(_kma_read_physical(rentry->phy2, (t_vaddrcc) rentry->opcodes + byte1, byte2));
+    }
+    rentry->ver1 = VRAM_GetVersion(rentry->phy1);
+    rentry->ver2 = VRAM_GetVersion(rentry->phy2);
+    rentry->linear = linear;
+    rentry->defsize = vcpu.data.cs.seg.exec.defsize;
+    rentry->flagA20 = vram.data.flagA20;
+    rentry->oplen = 15;
+    rentry->flagValid = True;
+    _ce;
+}
+/* loads instruction window at current linear address */
+static void _kfc_fetch() {
+    t_nubit32 oldexcept;
+    t_cpuins_data_fetch *rentry = &vcpuins.data.fcache[vcpuins.data.linear % VCPUINS_FCACHE_SIZE];
+    if (rentry->flagValid && rentry->linear == vcpuins.data.linear &&
+            rentry->defsize == vcpu.data.cs.seg.exec.defsize &&
+            rentry->flagA20 == vram.data.flagA20 &&
+            rentry->ver1 == VRAM_GetVersion(rentry->phy1) &&
+            rentry->ver2 == VRAM_GetVersion(rentry->phy2)) {
+        vcpuins.data.fcacheHit++;
+    } else {
+        vcpuins.data.fcacheMiss++;
+        rentry->flagValid = False;
+        oldexcept = vcpuins.data.except;
+        vcpuins.data.except = 0;
+        _kfj_try
+        _kfc_fill(rentry, vcpuins.data.linear);
+        _kfj_end
+        vcpuins.data.except = oldexcept;
+    }
+    if (rentry->flagValid) {
+        /* window keeps to the cs limit, so fetches inside it need no checks */
+        vcpuins.data.oplen = rentry->oplen;
+        if (vcpu.data.eip > vcpu.data.cs.limit) {
+            vcpuins.data.oplen = 0;
+        } else if (vcpu.data.cs.limit - vcpu.data.eip < vcpuins.data.oplen) {
+            vcpuins.data.oplen = (t_nubit8)(vcpu.data.cs.limit - vcpu.data.eip + 1);
+        }
+        MEMCPY((void *) vcpuins.data.opcodes, (void *) rentry->opcodes, vcpuins.data.oplen);
+    } else {
+        vcpuins.data.oplen = 0;
+    }
+}
 
 /* regular segment accessing */
 static t_bool _s_check_selector(t_nubit16 selector) {
@@ -889,8 +1452,19 @@ static void _s_read_es(t_nubit32 offset, t_vaddrcc rdata, t_nubit8 byte) {
     _ce;
 }
 static void _s_read_cs(t_nubit32 offset, t_vaddrcc rdata, t_nubit8 byte) {
+    t_nubit32 linear, index;
     _cb("_s_read_cs");
-    _chr(_kma_read_logical(&vcpu.data.cs, offset, rdata, byte, 0, 1));
+    index = GetMax32(vcpu.data.cs.base + offset - vcpuins.data.linear);
+    if (index < vcpuins.data.oplen && index + byte <= vcpuins.data.oplen) {
+        _bb("linear(in window)");
+        MEMCPY((void *) rdata, (void *)(vcpuins.data.opcodes + index), byte);
+        _be;
+    } else {
+        _bb("linear(out of window)");
+        _chr(linear = _kma_linear_logical(&vcpu.data.cs, offset, byte, 0, 0, 1));
+        _chr(_kma_read_linear(linear, rdata, byte, 0, 1));
+        _be;
+    }
     _ce;
 }
 static void _s_read_ss(t_nubit32 offset, t_vaddrcc rdata, t_nubit8 byte) {
@@ -1025,6 +1599,7 @@ static void _s_load_gdtr(t_nubit32 base, t_nubit16 limit, t_nubit8 byte) {
         _chr(_SetExcept_GP(0));
         _be;
     }
+    _kul_save_sreg(&vcpu.data.gdtr);
     vcpu.data.gdtr.limit = limit;
     switch (byte) {
     case 2:
@@ -1039,6 +1614,7 @@ static void _s_load_gdtr(t_nubit32 base, t_nubit16 limit, t_nubit8 byte) {
         _be;
         break;
     }
+    _ksa_load_access(&vcpu.data.gdtr);
     _ce;
 }
 static void _s_load_idtr(t_nubit32 base, t_nubit16 limit, t_nubit8 byte) {
@@ -1048,6 +1624,7 @@ static void _s_load_idtr(t_nubit32 base, t_nubit16 limit, t_nubit8 byte) {
         _chr(_SetExcept_GP(0));
         _be;
     }
+    _kul_save_sreg(&vcpu.data.idtr);
     vcpu.data.idtr.limit = limit;
     switch (byte) {
     case 2:
@@ -1062,6 +1639,7 @@ static void _s_load_idtr(t_nubit32 base, t_nubit16 limit, t_nubit8 byte) {
         _be;
         break;
     }
+    _ksa_load_access(&vcpu.data.idtr);
     _ce;
 }
 static void _s_load_ldtr(t_nubit16 selector) {
@@ -1095,12 +1673,14 @@ static void _s_load_tr(t_nubit16 selector) {
     _ce;
 }
 static void _s_load_cr0_msw(t_nubit16 msw) {
+    t_nubit32 oldcr0 = vcpu.data.cr0;
     _cb("_s_load_cr0_msw");
     if (_GetCPL) {
         _bb("CPL(!0)");
         _chr(_SetExcept_GP(0));
         _be;
     }
+    _kul_save_reg(&vcpu.data.cr0);
     if (!_GetCR0_PE) {
         _bb("CR0_PE(0)");
         vcpu.data.cr0 = (vcpu.data.cr0 & 0xfffffff0) | (msw & 0x000f);
@@ -1110,6 +1690,8 @@ static void _s_load_cr0_msw(t_nubit16 msw) {
         vcpu.data.cr0 = (vcpu.data.cr0 & 0xfffffff0) | (msw & 0x000e) | 0x01;
         _be;
     }
+    _kfc_flush();
+    if ((oldcr0 ^ vcpu.data.cr0) & VCPU_CR0_PE) _kma_flush_tlb();
     _ce;
 }
 static void _s_load_cs(t_nubit16 newcs) {
@@ -1208,6 +1790,7 @@ static void _p_input(t_nubit16 portid, t_vaddrcc rdata, t_nubit8 byte) {
         _be;
         break;
     }
+    vmachineWatch(portid, vport.data.ioDWord & (Max32 >> ((4 - byte) * 8)));
     vcpuins.data.flagIgnore = True;
     _ce;
 }
@@ -1237,6 +1820,7 @@ static void _p_output(t_nubit16 portid, t_vaddrcc rdata, t_nubit8 byte) {
         break;
     }
     vportExecWrite(portid);
+    vmachineWatchOutput();
     vcpuins.data.flagIgnore = True;
     _ce;
 }
@@ -1268,6 +1852,15 @@ static t_bool _kdf_check_prefix(t_nubit8 opcode) {
     return False;
 }
 
+/* cpu mode part of the dispatch table index */
+#define _GetSpecMode (_IsProtected ? VCPUINS_SPEC_PROT : VCPUINS_SPEC_REAL)
+/* selects the dispatch table for current mode and operand size */
+static void _kdf_select_table() {
+    t_nubit8 index = _GetSpecMode;
+    if (_GetOperandSize == 4) index |= VCPUINS_SPEC_OPR32;
+    vcpuins.data.rinsTable = vcpuins.connect.insTableSpec[index];
+}
+
 static void _kdf_skip(t_nubit8 byte) {
     _cb("_kdf_skip");
     _chr(vcpu.data.eip += byte);
@@ -1277,662 +1870,60 @@ static void _kdf_code(t_vaddrcc rdata, t_nubit8 byte) {
     _cb("_kdf_code");
     _chr(_s_read_cs(vcpu.data.eip, rdata, byte));
     _chr(_kdf_skip(byte));
-    _ce;
-}
-static void _kdf_modrm(t_nubit8 regbyte, t_nubit8 rmbyte) {
-    t_nsbit8 disp8;
-    t_nubit16 disp16;
-    t_nubit32 disp32;
-    t_nubit32 sibindex;
-    t_nubit8 modrm, sib;
-    _cb("_kdf_modrm");
-    _chr(_kdf_code(GetRef(modrm), 1));
-    vcpuins.data.flagMem = True;
-    vcpuins.data.mrm.rsreg = NULL;
-    vcpuins.data.mrm.offset = 0;
-    vcpuins.data.cr = vcpuins.data.crm = 0;
-    vcpuins.data.rrm = vcpuins.data.rr = (t_vaddrcc)NULL;
-    switch (_GetAddressSize) {
-    case 2:
-        _bb("AddressSize(2)");
-        switch (_GetModRM_MOD(modrm)) {
-        case 0:
-            _bb("ModRM_MOD(0)");
-            switch (_GetModRM_RM(modrm)) {
-            case 0:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bx + vcpu.data.si);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 1:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bx + vcpu.data.di);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 2:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bp + vcpu.data.si);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverss;
-                break;
-            case 3:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bp + vcpu.data.di);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverss;
-                break;
-            case 4:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.si);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 5:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.di);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 6:
-                _bb("ModRM_RM(6)");
-                _chr(_kdf_code(GetRef(disp16), 2));
-                vcpuins.data.mrm.offset = GetMax16(disp16);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                _be;
-                break;
-            case 7:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bx);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
-            _be;
-            break;
-        case 1:
-            _bb("ModRM_MOD(1)");
-            _chr(_kdf_code(GetRef(disp8), 1));
-            switch (_GetModRM_RM(modrm)) {
-            case 0:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bx + vcpu.data.si + disp8);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 1:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bx + vcpu.data.di + disp8);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 2:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bp + vcpu.data.si + disp8);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverss;
-                break;
-            case 3:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bp + vcpu.data.di + disp8);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverss;
-                break;
-            case 4:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.si + disp8);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 5:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.di + disp8);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 6:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bp + disp8);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverss;
-                break;
-            case 7:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bx + disp8);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
-            _be;
-            break;
-        case 2:
-            _bb("ModRM_MOD(2)");
-            _chr(_kdf_code(GetRef(disp16), 2));
-            switch (_GetModRM_RM(modrm)) {
-            case 0:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bx + vcpu.data.si + disp16);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 1:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bx + vcpu.data.di + disp16);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 2:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bp + vcpu.data.si + disp16);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverss;
-                break;
-            case 3:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bp + vcpu.data.di + disp16);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverss;
-                break;
-            case 4:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.si + disp16);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 5:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.di + disp16);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 6:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bp + disp16);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverss;
-                break;
-            case 7:
-                vcpuins.data.mrm.offset = GetMax16(vcpu.data.bx + disp16);
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
-            _be;
-            break;
-        case 3:
-            break;
-        default:
-            _impossible_r_;
-            break;
-        }
-        _be;
-        break;
-    case 4:
-        _bb("AddressSize(4)");
-        if (_GetModRM_MOD(modrm) != 3 && _GetModRM_RM(modrm) == 4) {
-            _bb("ModRM_MOD(!3),ModRM_RM(4)");
-            _chr(_kdf_code(GetRef(sib), 1));
-            switch (_GetSIB_Index(sib)) {
-            case 0:
-                sibindex = vcpu.data.eax;
-                break;
-            case 1:
-                sibindex = vcpu.data.ecx;
-                break;
-            case 2:
-                sibindex = vcpu.data.edx;
-                break;
-            case 3:
-                sibindex = vcpu.data.ebx;
-                break;
-            case 4:
-                sibindex = 0x00000000;
-                break;
-            case 5:
-                sibindex = vcpu.data.ebp;
-                break;
-            case 6:
-                sibindex = vcpu.data.esi;
-                break;
-            case 7:
-                sibindex = vcpu.data.edi;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
-            sibindex <<= _GetSIB_SS(sib);
-            _be;
-        }
-        switch (_GetModRM_MOD(modrm)) {
-        case 0:
-            _bb("ModRM_MOD(0)");
-            switch (_GetModRM_RM(modrm)) {
-            case 0:
-                vcpuins.data.mrm.offset = vcpu.data.eax;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 1:
-                vcpuins.data.mrm.offset = vcpu.data.ecx;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 2:
-                vcpuins.data.mrm.offset = vcpu.data.edx;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 3:
-                vcpuins.data.mrm.offset = vcpu.data.ebx;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 4:
-                _bb("ModRM_RM(4)");
-                switch (_GetSIB_Base(sib)) {
-                case 0:
-                    vcpuins.data.mrm.offset = vcpu.data.eax + sibindex;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                case 1:
-                    vcpuins.data.mrm.offset = vcpu.data.ecx + sibindex;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                case 2:
-                    vcpuins.data.mrm.offset = vcpu.data.edx + sibindex;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                case 3:
-                    vcpuins.data.mrm.offset = vcpu.data.ebx + sibindex;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                case 4:
-                    vcpuins.data.mrm.offset = vcpu.data.esp + sibindex;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverss;
-                    break;
-                case 5:
-                    _bb("SIB_Base(5)");
-                    _chr(_kdf_code(GetRef(disp32), 4));
-                    vcpuins.data.mrm.offset = disp32 + sibindex;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    _be;
-                    break;
-                case 6:
-                    vcpuins.data.mrm.offset = vcpu.data.esi + sibindex;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                case 7:
-                    vcpuins.data.mrm.offset = vcpu.data.edi + sibindex;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                default:
-                    _impossible_r_;
-                    break;
-                }
-                _be;
-                break;
-            case 5:
-                _bb("ModRM_RM(5)");
-                _chr(_kdf_code(GetRef(disp32), 4));
-                vcpuins.data.mrm.offset = disp32;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                _be;
-                break;
-            case 6:
-                vcpuins.data.mrm.offset = vcpu.data.esi;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 7:
-                vcpuins.data.mrm.offset = vcpu.data.edi;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
-            _be;
-            break;
-        case 1:
-            _bb("ModRM_MOD(1)");
-            _chr(_kdf_code(GetRef(disp8), 1));
-            switch (_GetModRM_RM(modrm)) {
-            case 0:
-                vcpuins.data.mrm.offset = vcpu.data.eax + disp8;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 1:
-                vcpuins.data.mrm.offset = vcpu.data.ecx + disp8;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 2:
-                vcpuins.data.mrm.offset = vcpu.data.edx + disp8;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 3:
-                vcpuins.data.mrm.offset = vcpu.data.ebx + disp8;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 4:
-                _bb("ModRM_RM(4)");
-                switch (_GetSIB_Base(sib)) {
-                case 0:
-                    vcpuins.data.mrm.offset = vcpu.data.eax + sibindex + disp8;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                case 1:
-                    vcpuins.data.mrm.offset = vcpu.data.ecx + sibindex + disp8;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                case 2:
-                    vcpuins.data.mrm.offset = vcpu.data.edx + sibindex + disp8;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                case 3:
-                    vcpuins.data.mrm.offset = vcpu.data.ebx + sibindex + disp8;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                case 4:
-                    vcpuins.data.mrm.offset = vcpu.data.esp + sibindex + disp8;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverss;
-                    break;
-                case 5:
-                    vcpuins.data.mrm.offset = vcpu.data.ebp + sibindex + disp8;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverss;
-                    break;
-                case 6:
-                    vcpuins.data.mrm.offset = vcpu.data.esi + sibindex + disp8;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                case 7:
-                    vcpuins.data.mrm.offset = vcpu.data.edi + sibindex + disp8;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                default:
-                    _impossible_r_;
-                    break;
-                }
-                _be;
-                break;
-            case 5:
-                vcpuins.data.mrm.offset = vcpu.data.ebp + disp8;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverss;
-                break;
-            case 6:
-                vcpuins.data.mrm.offset = vcpu.data.esi + disp8;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 7:
-                vcpuins.data.mrm.offset = vcpu.data.edi + disp8;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
-            _be;
-            break;
-        case 2:
-            _bb("ModRM_MOD(2)");
-            _chr(_kdf_code(GetRef(disp32), 4));
-            switch (_GetModRM_RM(modrm)) {
-            case 0:
-                vcpuins.data.mrm.offset = vcpu.data.eax + disp32;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 1:
-                vcpuins.data.mrm.offset = vcpu.data.ecx + disp32;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 2:
-                vcpuins.data.mrm.offset = vcpu.data.edx + disp32;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 3:
-                vcpuins.data.mrm.offset = vcpu.data.ebx + disp32;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 4:
-                _bb("ModRM_RM(4)");
-                switch (_GetSIB_Base(sib)) {
-                case 0:
-                    vcpuins.data.mrm.offset = vcpu.data.eax + sibindex + disp32;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                case 1:
-                    vcpuins.data.mrm.offset = vcpu.data.ecx + sibindex + disp32;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                case 2:
-                    vcpuins.data.mrm.offset = vcpu.data.edx + sibindex + disp32;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                case 3:
-                    vcpuins.data.mrm.offset = vcpu.data.ebx + sibindex + disp32;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                case 4:
-                    vcpuins.data.mrm.offset = vcpu.data.esp + sibindex + disp32;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverss;
-                    break;
-                case 5:
-                    vcpuins.data.mrm.offset = vcpu.data.ebp + sibindex + disp32;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverss;
-                    break;
-                case 6:
-                    vcpuins.data.mrm.offset = vcpu.data.esi + sibindex + disp32;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                case 7:
-                    vcpuins.data.mrm.offset = vcpu.data.edi + sibindex + disp32;
-                    vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                    break;
-                default:
-                    _impossible_r_;
-                    break;
-                }
-                _be;
-                break;
-            case 5:
-                vcpuins.data.mrm.offset = vcpu.data.ebp + disp32;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverss;
-                break;
-            case 6:
-                vcpuins.data.mrm.offset = vcpu.data.esi + disp32;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            case 7:
-                vcpuins.data.mrm.offset = vcpu.data.edi + disp32;
-                vcpuins.data.mrm.rsreg = vcpuins.data.roverds;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
-            _be;
-            break;
-        case 3:
-            break;
-        default:
-            _impossible_r_;
-            break;
-        }
-        _be;
-        break;
-    default:
-        _impossible_r_;
-        break;
-    }
-    if (_GetModRM_MOD(modrm) == 3) {
-        _bb("ModRM_MOD(3)");
-        vcpuins.data.flagMem = False;
-        switch (rmbyte) {
-        case 1:
-            switch (_GetModRM_RM(modrm)) {
-            case 0:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.al);
-                break;
-            case 1:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.cl);
-                break;
-            case 2:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.dl);
-                break;
-            case 3:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.bl);
-                break;
-            case 4:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.ah);
-                break;
-            case 5:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.ch);
-                break;
-            case 6:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.dh);
-                break;
-            case 7:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.bh);
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
-            break;
-        case 2:
-            switch (_GetModRM_RM(modrm)) {
-            case 0:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.ax);
-                break;
-            case 1:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.cx);
-                break;
-            case 2:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.dx);
-                break;
-            case 3:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.bx);
-                break;
-            case 4:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.sp);
-                break;
-            case 5:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.bp);
-                break;
-            case 6:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.si);
-                break;
-            case 7:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.di);
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
-            break;
-        case 4:
-            switch (_GetModRM_RM(modrm)) {
-            case 0:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.eax);
-                break;
-            case 1:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.ecx);
-                break;
-            case 2:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.edx);
-                break;
-            case 3:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.ebx);
-                break;
-            case 4:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.esp);
-                break;
-            case 5:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.ebp);
-                break;
-            case 6:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.esi);
-                break;
-            case 7:
-                vcpuins.data.rrm = (t_vaddrcc)(&vcpu.data.edi);
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
-            break;
-        default:
-            _bb("rmbyte");
-            _chr(_SetExcept_CE(rmbyte));
-            _be;
-            break;
-        }
-        _chr(_m_read_ref(vcpuins.data.rrm, GetRef(vcpuins.data.crm), rmbyte));
-        _be;
-    }
-    if (!regbyte) {
-        /* reg is operation or segment */
-        vcpuins.data.cr = _GetModRM_REG(modrm);
-    } else {
-        switch (regbyte) {
-        case 1:
-            switch (_GetModRM_REG(modrm)) {
-            case 0:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.al);
-                break;
-            case 1:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.cl);
-                break;
-            case 2:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.dl);
-                break;
-            case 3:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.bl);
-                break;
-            case 4:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.ah);
-                break;
-            case 5:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.ch);
-                break;
-            case 6:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.dh);
-                break;
-            case 7:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.bh);
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
-            break;
-        case 2:
-            switch (_GetModRM_REG(modrm)) {
-            case 0:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.ax);
-                break;
-            case 1:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.cx);
-                break;
-            case 2:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.dx);
-                break;
-            case 3:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.bx);
-                break;
-            case 4:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.sp);
-                break;
-            case 5:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.bp);
-                break;
-            case 6:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.si);
-                break;
-            case 7:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.di);
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
-            break;
-        case 4:
-            switch (_GetModRM_REG(modrm)) {
-            case 0:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.eax);
-                break;
-            case 1:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.ecx);
-                break;
-            case 2:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.edx);
-                break;
-            case 3:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.ebx);
-                break;
-            case 4:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.esp);
-                break;
-            case 5:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.ebp);
-                break;
-            case 6:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.esi);
-                break;
-            case 7:
-                vcpuins.data.rr = (t_vaddrcc)(&vcpu.data.edi);
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
-            break;
-        default:
+    _ce;
+}
+static void _kdf_modrm(t_nubit8 regbyte, t_nubit8 rmbyte) {
+    t_nubit8 modrm, sib, dispsize;
+    t_nubit32 disp = 0;
+    t_cpuins_ea *rea;
+    _cb("_kdf_modrm");
+    _chr(_kdf_code(GetRef(modrm), 1));
+    vcpuins.data.flagMem = True;
+    vcpuins.data.mrm.rsreg = NULL;
+    vcpuins.data.mrm.offset = 0;
+    vcpuins.data.cr = vcpuins.data.crm = 0;
+    vcpuins.data.rrm = vcpuins.data.rr = (t_vaddrcc)NULL;
+    if (_GetModRM_MOD(modrm) != 3) {
+        _bb("ModRM_MOD(!3)");
+        rea = &vcpuins.connect.eaTable[_GetAddressSize == 4][modrm];
+        dispsize = rea->disp;
+        if (rea->flagSIB) {
+            _chr(_kdf_code(GetRef(sib), 1));
+            rea = &vcpuins.connect.sibTable[_GetModRM_MOD(modrm) != 0][sib];
+            dispsize |= rea->disp;
+        }
+        if (dispsize) {
+            _chr(_kdf_code(GetRef(disp), dispsize));
+            if (dispsize == 1) disp = (t_nubit32)(t_nsbit32)(t_nsbit8)disp;
+        }
+        vcpuins.data.mrm.offset = d_nubit32(vcpuins.connect.eaReg[rea->base]) +
+            (d_nubit32(vcpuins.connect.eaReg[rea->index]) << rea->scale) + disp;
+        if (_GetAddressSize == 2) vcpuins.data.mrm.offset = GetMax16(vcpuins.data.mrm.offset);
+        vcpuins.data.mrm.rsreg = rea->flagSS ? vcpuins.data.roverss : vcpuins.data.roverds;
+        _be;
+    } else {
+        _bb("ModRM_MOD(3)");
+        vcpuins.data.flagMem = False;
+        if (rmbyte == 1 || rmbyte == 2 || rmbyte == 4) {
+            vcpuins.data.rrm = vcpuins.connect.regTable[rmbyte >> 1][_GetModRM_RM(modrm)];
+        } else {
+            _bb("rmbyte");
+            _chr(_SetExcept_CE(rmbyte));
+            _be;
+        }
+        _chr(_m_read_ref(vcpuins.data.rrm, GetRef(vcpuins.data.crm), rmbyte));
+        _be;
+    }
+    if (!regbyte) {
+        /* reg is operation or segment */
+        vcpuins.data.cr = _GetModRM_REG(modrm);
+    } else {
+        if (regbyte == 1 || regbyte == 2 || regbyte == 4) {
+            vcpuins.data.rr = vcpuins.connect.regTable[regbyte >> 1][_GetModRM_REG(modrm)];
+        } else {
             _bb("regbyte");
             _chr(_SetExcept_CE(regbyte));
             _be;
-            break;
         }
         _chr(_m_read_ref(vcpuins.data.rr, GetRef(vcpuins.data.cr), regbyte));
     }
@@ -2120,6 +2111,7 @@ static void _kec_call_far(t_nubit16 newcs, t_nubit32 neweip, t_nubit8 byte) {
         _be;
         break;
     }
+    _kul_save_sreg(&vcpu.data.cs);
     vcpu.data.cs = ccs;
     vcpu.data.eip = neweip;
     _ce;
@@ -2169,6 +2161,7 @@ static void _kec_jmp_far(t_nubit16 newcs, t_nubit32 neweip, t_nubit8 byte) {
     }
     _chr(_ksa_load_sreg(&ccs, newcs));
     _chr(_kma_test_logical(&ccs, neweip, 0x01, 0, 0x00, 1));
+    _kul_save_sreg(&vcpu.data.cs);
     vcpu.data.cs = ccs;
     vcpu.data.eip = neweip;
     _ce;
@@ -2210,6 +2203,7 @@ static void _kec_ret_far(t_nubit32 newcs, t_nubit32 neweip, t_nubit16 parambyte,
     }
     _chr(_ksa_load_sreg(&ccs, newcs));
     _chr(_kma_test_logical(&ccs, neweip, 0x01, 0, 0x00, 1));
+    _kul_save_sreg(&vcpu.data.cs);
     vcpu.data.cs = ccs;
     vcpu.data.eip = neweip;
     switch (_GetStackSize) {
@@ -2532,6 +2526,7 @@ _______todo _ser_int_protected(t_nubit8 intid, t_nubit8 byte, t_bool flagext) {
                 }*/
                 oldeflags = vcpu.data.eflags;
                 _ClrEFLAGS_VM;
+                _kul_save_sreg(&vcpu.data.cs);
                 _MakeCPL(0x00);
                 _ClrEFLAGS_TF;
                 _ClrEFLAGS_NT;
@@ -2851,6 +2846,7 @@ _______todo _e_iret(t_nubit8 byte) {
         }
         _chr(_ksa_load_sreg(&ccs, newcs));
         _chr(_kma_test_logical(&ccs, neweip, 0x01, 0, 0x00, 1));
+        _kul_save_sreg(&vcpu.data.cs);
         vcpu.data.cs = ccs;
         vcpu.data.eip = neweip;
         vcpu.data.eflags = (neweflags & ~mask) | (vcpu.data.eflags & mask);
@@ -2891,6 +2887,7 @@ _______todo _e_iret(t_nubit8 byte) {
                 }
                 _chr(_ksa_load_sreg(&ccs, newcs));
                 _chr(_kma_test_logical(&ccs, neweip, 0x01, 0, 0x00, 1));
+                _kul_save_sreg(&vcpu.data.cs);
                 vcpu.data.cs = ccs;
                 vcpu.data.eip = neweip;
                 vcpu.data.eflags = (neweflags & ~mask) | (vcpu.data.eflags & mask);
@@ -2898,7 +2895,7 @@ _______todo _e_iret(t_nubit8 byte) {
             } else {
                 _bb("EFLAGS_IOPL(!3)");
                 /* trap to virtual-8086 monitor */
-                vcpuins.data.oldcpu = vcpu;
+                _kul_init();
                 _chr(_SetExcept_GP(0));
                 _be;
             }
@@ -2941,6 +2938,7 @@ _______todo _e_iret(t_nubit8 byte) {
                 vcpu.data.eflags = (neweflags & ~mask) | (vcpu.data.eflags & mask);
                 _chr(_ksa_load_sreg(&ccs, newcs));
                 _chr(_kma_test_logical(&ccs, neweip, 0x01, 0, 0x00, 1));
+                _kul_save_sreg(&vcpu.data.cs);
                 vcpu.data.cs = ccs;
                 vcpu.data.eip = neweip;
                 _chr(_kec_pop(GetRef(newesp), 4));
@@ -2960,6 +2958,7 @@ _______todo _e_iret(t_nubit8 byte) {
                 _chr(_s_load_ds(newds));
                 _chr(_s_load_fs(newfs));
                 _chr(_s_load_gs(newgs));
+                _kul_save_sreg(&vcpu.data.cs);
                 _MakeCPL(0x03);
                 _be;
             } else {
@@ -3063,6 +3062,8 @@ static void _e_load_far(t_cpu_data_sreg *rsreg, t_vaddrcc rdest, t_nubit16 selec
     }
     _ce;
 }
+/* completes delay loops arithmetically, see delay loop unit */
+static void _kdl_loop(t_nubit32 cecx);
 static void _e_loopcc(t_nsbit8 csrc, t_bool condition) {
     t_nubit32 cecx;
     t_nubit32 neweip = vcpu.data.eip;
@@ -3084,6 +3085,9 @@ static void _e_loopcc(t_nsbit8 csrc, t_bool condition) {
         _bb("cecx(!0),condition(1)");
         neweip += csrc;
         _chr(_kec_jmp_near(neweip, _GetOperandSize));
+        if (vcpu.data.eip == vcpuins.data.receip) {
+            _kdl_loop(cecx);
+        }
         _be;
     }
     _ce;
@@ -3204,40 +3208,35 @@ static void _e_ret_far(t_nubit16 parambyte, t_nubit16 byte) {
 #define DAA_FLAG  (VCPU_EFLAGS_SF | VCPU_EFLAGS_ZF | VCPU_EFLAGS_PF)
 #define DAS_FLAG  (VCPU_EFLAGS_SF | VCPU_EFLAGS_ZF | VCPU_EFLAGS_PF)
 
-static void _kaf_calc_CF() {
+static t_bool _kaf_calc_CF(t_cpu_data_lazy *rlazy) {
+    t_bool flag = False;
     _cb("_kaf_calc_CF");
-    switch (vcpuins.data.type) {
+    switch (rlazy->type) {
     case ADC8:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_CF, (
-                    (_GetEFLAGS_CF && vcpuins.data.opr2 == Max8) ?
-                    1 : ((vcpuins.data.result < vcpuins.data.opr1) || (vcpuins.data.result < vcpuins.data.opr2))));
+        flag = (rlazy->cf && rlazy->opr2 == Max8) ?
+               1 : ((rlazy->result < rlazy->opr1) || (rlazy->result < rlazy->opr2));
         break;
     case ADC16:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_CF, (
-                    (_GetEFLAGS_CF && vcpuins.data.opr2 == Max16) ?
-                    1 : ((vcpuins.data.result < vcpuins.data.opr1) || (vcpuins.data.result < vcpuins.data.opr2))));
+        flag = (rlazy->cf && rlazy->opr2 == Max16) ?
+               1 : ((rlazy->result < rlazy->opr1) || (rlazy->result < rlazy->opr2));
         break;
     case ADC32:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_CF, (
-                    (_GetEFLAGS_CF && vcpuins.data.opr2 == Max32) ?
-                    1 : ((vcpuins.data.result < vcpuins.data.opr1) || (vcpuins.data.result < vcpuins.data.opr2))));
+        flag = (rlazy->cf && rlazy->opr2 == Max32) ?
+               1 : ((rlazy->result < rlazy->opr1) || (rlazy->result < rlazy->opr2));
         break;
     case ADD8:
     case ADD16:
     case ADD32:
-        MakeBit(vcpu.data.eflags,VCPU_EFLAGS_CF,(vcpuins.data.result < vcpuins.data.opr1) || (vcpuins.data.result < vcpuins.data.opr2));
+        flag = (rlazy->result < rlazy->opr1) || (rlazy->result < rlazy->opr2);
         break;
     case SBB8:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_CF, (vcpuins.data.opr1 < vcpuins.data.result) ||
-                (_GetEFLAGS_CF && (vcpuins.data.opr2 == Max8)));
+        flag = (rlazy->opr1 < rlazy->result) || (rlazy->cf && (rlazy->opr2 == Max8));
         break;
     case SBB16:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_CF, (vcpuins.data.opr1 < vcpuins.data.result) ||
-                (_GetEFLAGS_CF && (vcpuins.data.opr2 == Max16)));
+        flag = (rlazy->opr1 < rlazy->result) || (rlazy->cf && (rlazy->opr2 == Max16));
         break;
     case SBB32:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_CF, (vcpuins.data.opr1 < vcpuins.data.result) ||
-                (_GetEFLAGS_CF && (vcpuins.data.opr2 == Max32)));
+        flag = (rlazy->opr1 < rlazy->result) || (rlazy->cf && (rlazy->opr2 == Max32));
         break;
     case SUB8:
     case SUB16:
@@ -3245,109 +3244,137 @@ static void _kaf_calc_CF() {
     case CMP8:
     case CMP16:
     case CMP32:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_CF, vcpuins.data.opr1 < vcpuins.data.opr2);
+        flag = rlazy->opr1 < rlazy->opr2;
         break;
     default:
         _bb("type");
-        _chr(_SetExcept_CE(vcpuins.data.type));
+        _chrz(_SetExcept_CE(rlazy->type));
         _be;
         break;
     }
     _ce;
+    return flag;
 }
-static void _kaf_calc_OF() {
+static t_bool _kaf_calc_OF(t_cpu_data_lazy *rlazy) {
+    t_bool flag = False;
     _cb("_kaf_calc_OF");
-    switch (vcpuins.data.type) {
+    switch (rlazy->type) {
     case ADC8:
     case ADD8:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_OF,
-                (GetMSB8(vcpuins.data.opr1) == GetMSB8(vcpuins.data.opr2)) && (GetMSB8(vcpuins.data.opr1) != GetMSB8(vcpuins.data.result)));
+        flag = (GetMSB8(rlazy->opr1) == GetMSB8(rlazy->opr2)) && (GetMSB8(rlazy->opr1) != GetMSB8(rlazy->result));
         break;
     case ADC16:
     case ADD16:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_OF,
-                (GetMSB16(vcpuins.data.opr1) == GetMSB16(vcpuins.data.opr2)) && (GetMSB16(vcpuins.data.opr1) != GetMSB16(vcpuins.data.result)));
+        flag = (GetMSB16(rlazy->opr1) == GetMSB16(rlazy->opr2)) && (GetMSB16(rlazy->opr1) != GetMSB16(rlazy->result));
         break;
     case ADC32:
     case ADD32:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_OF,
-                (GetMSB32(vcpuins.data.opr1) == GetMSB32(vcpuins.data.opr2)) && (GetMSB32(vcpuins.data.opr1) != GetMSB32(vcpuins.data.result)));
+        flag = (GetMSB32(rlazy->opr1) == GetMSB32(rlazy->opr2)) && (GetMSB32(rlazy->opr1) != GetMSB32(rlazy->result));
         break;
     case SBB8:
     case SUB8:
     case CMP8:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_OF,
-                (GetMSB8(vcpuins.data.opr1) != GetMSB8(vcpuins.data.opr2)) && (GetMSB8(vcpuins.data.opr2) == GetMSB8(vcpuins.data.result)));
+        flag = (GetMSB8(rlazy->opr1) != GetMSB8(rlazy->opr2)) && (GetMSB8(rlazy->opr2) == GetMSB8(rlazy->result));
         break;
     case SBB16:
     case SUB16:
     case CMP16:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_OF,
-                (GetMSB16(vcpuins.data.opr1) != GetMSB16(vcpuins.data.opr2)) && (GetMSB16(vcpuins.data.opr2) == GetMSB16(vcpuins.data.result)));
+        flag = (GetMSB16(rlazy->opr1) != GetMSB16(rlazy->opr2)) && (GetMSB16(rlazy->opr2) == GetMSB16(rlazy->result));
         break;
     case SBB32:
     case SUB32:
     case CMP32:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_OF,
-                (GetMSB32(vcpuins.data.opr1) != GetMSB32(vcpuins.data.opr2)) && (GetMSB32(vcpuins.data.opr2) == GetMSB32(vcpuins.data.result)));
+        flag = (GetMSB32(rlazy->opr1) != GetMSB32(rlazy->opr2)) && (GetMSB32(rlazy->opr2) == GetMSB32(rlazy->result));
         break;
     default:
         _bb("type");
-        _chr(_SetExcept_CE(vcpuins.data.type));
+        _chrz(_SetExcept_CE(rlazy->type));
         _be;
         break;
     }
     _ce;
+    return flag;
 }
-static void _kaf_calc_AF() {
-    _cb("_kaf_calc_AF");
-    MakeBit(vcpu.data.eflags, VCPU_EFLAGS_AF, ((vcpuins.data.opr1 ^ vcpuins.data.opr2) ^ vcpuins.data.result) & 0x10);
-    _ce;
+static t_bool _kaf_calc_AF(t_cpu_data_lazy *rlazy) {
+    return !!(((rlazy->opr1 ^ rlazy->opr2) ^ rlazy->result) & 0x10);
 }
-static void _kaf_calc_PF() {
-    t_nubit8 res8 = GetMax8(vcpuins.data.result);
+static t_bool _kaf_calc_PF(t_cpu_data_lazy *rlazy) {
+    t_nubit8 res8 = GetMax8(rlazy->result);
     t_bool even = 1;
-    _cb("_kaf_calc_PF");
     while (res8) {
         even = 1 - even;
         res8 &= res8-1;
     }
-    MakeBit(vcpu.data.eflags, VCPU_EFLAGS_PF, even);
-    _ce;
+    return even;
 }
-static void _kaf_calc_ZF() {
-    _cb("_kaf_calc_ZF");
-    MakeBit(vcpu.data.eflags, VCPU_EFLAGS_ZF, !vcpuins.data.result);
-    _ce;
+static t_bool _kaf_calc_ZF(t_cpu_data_lazy *rlazy) {
+    return !rlazy->result;
 }
-static void _kaf_calc_SF() {
+static t_bool _kaf_calc_SF(t_cpu_data_lazy *rlazy) {
+    t_bool flag = False;
     _cb("_kaf_calc_SF");
-    switch (vcpuins.data.bit) {
+    switch (rlazy->bit) {
     case 8:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_SF, GetMSB8(vcpuins.data.result));
+        flag = !!GetMSB8(rlazy->result);
         break;
     case 16:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_SF, GetMSB16(vcpuins.data.result));
+        flag = !!GetMSB16(rlazy->result);
         break;
     case 32:
-        MakeBit(vcpu.data.eflags, VCPU_EFLAGS_SF, GetMSB32(vcpuins.data.result));
+        flag = !!GetMSB32(rlazy->result);
         break;
     default:
         _bb("bit");
-        _chr(_SetExcept_CE(vcpuins.data.bit));
-        _be;
-        break;
+        _chrz(_SetExcept_CE(rlazy->bit));
+        _be;
+        break;
+    }
+    _ce;
+    return flag;
+}
+/* evaluates status flags from the recorded operation */
+static t_nubit32 _kaf_calc(t_cpu_data_lazy *rlazy, t_nubit32 flags) {
+    t_nubit32 value = Zero32;
+    if ((flags & VCPU_EFLAGS_CF) && _kaf_calc_CF(rlazy)) value |= VCPU_EFLAGS_CF;
+    if ((flags & VCPU_EFLAGS_PF) && _kaf_calc_PF(rlazy)) value |= VCPU_EFLAGS_PF;
+    if ((flags & VCPU_EFLAGS_AF) && _kaf_calc_AF(rlazy)) value |= VCPU_EFLAGS_AF;
+    if ((flags & VCPU_EFLAGS_ZF) && _kaf_calc_ZF(rlazy)) value |= VCPU_EFLAGS_ZF;
+    if ((flags & VCPU_EFLAGS_SF) && _kaf_calc_SF(rlazy)) value |= VCPU_EFLAGS_SF;
+    if ((flags & VCPU_EFLAGS_OF) && _kaf_calc_OF(rlazy)) value |= VCPU_EFLAGS_OF;
+    return value;
+}
+/* materializes pending status flags into eflags */
+static void _kaf_sync(t_nubit32 flags) {
+    t_nubit32 value;
+    flags &= vcpu.data.lazy.flags;
+    if (!flags) return;
+    value = _kaf_calc(&vcpu.data.lazy, flags);
+#if VCPUINS_LAZY_CHECK == 1
+    if ((vcpu.data.eflags & flags) != value) {
+        PRINTF("Lazy flags mismatch at L%08x: TYPE=%d, EAGER=%08x, LAZY=%08x\n",
+               vcpuins.data.linear, vcpu.data.lazy.type, vcpu.data.eflags & flags, value);
+        deviceStop();
     }
-    _ce;
+#else
+    vcpu.data.eflags = (vcpu.data.eflags & ~flags) | value;
+#endif
+    vcpu.data.lazy.flags &= ~flags;
 }
+/* records the arithmetic operation; flags are evaluated when consumed */
 static void _kaf_set_flags(t_nubit16 flags) {
     _cb("_kaf_set_flags");
-    if (flags & VCPU_EFLAGS_CF) _chr(_kaf_calc_CF());
-    if (flags & VCPU_EFLAGS_PF) _chr(_kaf_calc_PF());
-    if (flags & VCPU_EFLAGS_AF) _chr(_kaf_calc_AF());
-    if (flags & VCPU_EFLAGS_ZF) _chr(_kaf_calc_ZF());
-    if (flags & VCPU_EFLAGS_SF) _chr(_kaf_calc_SF());
-    if (flags & VCPU_EFLAGS_OF) _chr(_kaf_calc_OF());
+    _kaf_sync(vcpu.data.lazy.flags & ~flags);
+    vcpu.data.lazy.flags = flags;
+    vcpu.data.lazy.type = vcpuins.data.type;
+    vcpu.data.lazy.bit = vcpuins.data.bit;
+    vcpu.data.lazy.cf = GetBit(vcpu.data.eflags, VCPU_EFLAGS_CF);
+    vcpu.data.lazy.opr1 = vcpuins.data.opr1;
+    vcpu.data.lazy.opr2 = vcpuins.data.opr2;
+    vcpu.data.lazy.result = vcpuins.data.result;
+#if VCPUINS_LAZY_CHECK == 1
+    vcpu.data.eflags = (vcpu.data.eflags & ~flags) | _kaf_calc(&vcpu.data.lazy, flags);
+#endif
+    if (!vcpuins.data.flagLazy) _kaf_sync(flags);
     _ce;
 }
 static void _kas_move_index(t_nubit8 byte, t_bool flagsi, t_bool flagdi) {
@@ -3377,6 +3404,110 @@ static void _kas_move_index(t_nubit8 byte, t_bool flagsi, t_bool flagdi) {
     }
     _ce;
 }
+/* number of string elements from offset that lie in the host pointer window;
+   none while a watch point needs to see each access */
+static t_nubit32 _kas_bulk_count(t_cpu_data_sreg *rsreg, t_nubit32 offset, t_nubit8 byte, t_nubit32 count, t_bool write) {
+    t_nubit32 upper, n;
+    if (vcpuins.data.flagWR || vcpuins.data.flagWW) return 0;
+    if (!(write ? rsreg->hostWrite : rsreg->hostRead) || !_IsHostWindow(rsreg, offset, byte)) return 0;
+    upper = rsreg->hostUpper;
+    if (_GetAddressSize == 2 && upper > 0x0000ffff) upper = 0x0000ffff;
+    if (offset > upper) return 0;
+    if (_GetEFLAGS_DF) {
+        n = (offset - rsreg->hostLower) / byte + 1;
+    } else {
+        n = (t_nubit32)(((t_nubit64) upper - offset + 1) / byte);
+    }
+    return (n < count) ? n : count;
+}
+/* advances count and index registers over n string elements */
+static void _kas_bulk_move_index(t_nubit32 n, t_nubit8 byte, t_bool flagsi, t_bool flagdi) {
+    t_nubit32 delta = n * byte;
+    switch (_GetAddressSize) {
+    case 2:
+        vcpu.data.cx -= n;
+        if (_GetEFLAGS_DF) {
+            if (flagdi) vcpu.data.di -= delta;
+            if (flagsi) vcpu.data.si -= delta;
+        } else {
+            if (flagdi) vcpu.data.di += delta;
+            if (flagsi) vcpu.data.si += delta;
+        }
+        break;
+    case 4:
+        vcpu.data.ecx -= n;
+        if (_GetEFLAGS_DF) {
+            if (flagdi) vcpu.data.edi -= delta;
+            if (flagsi) vcpu.data.esi -= delta;
+        } else {
+            if (flagdi) vcpu.data.edi += delta;
+            if (flagsi) vcpu.data.esi += delta;
+        }
+        break;
+    default:
+        break;
+    }
+}
+/* host address of the lowest of n string elements from offset */
+static t_vaddrcc _kas_bulk_host(t_cpu_data_sreg *rsreg, t_nubit32 offset, t_nubit8 byte, t_nubit32 n) {
+    if (_GetEFLAGS_DF) offset -= (n - 1) * byte;
+    return rsreg->hostBase + offset;
+}
+/* copy n string elements as if they were moved one by one */
+static void _kas_bulk_movs(t_vaddrcc dest, t_vaddrcc src, t_nubit8 byte, t_nubit32 n) {
+    t_nubit32 i, k, data;
+    t_nubit32 len = n * byte;
+    if (dest + len <= src || src + len <= dest) {
+        MEMCPY((void *) dest, (void *) src, len);
+    } else if (_GetEFLAGS_DF ? dest >= src : dest <= src) {
+        MEMMOVE((void *) dest, (void *) src, len);
+    } else {
+        /* destination overtakes source: elements repeat */
+        for (i = 0; i < n; ++i) {
+            k = _GetEFLAGS_DF ? (n - 1 - i) : i;
+            _kma_read_host(src + k * byte, GetRef(data), byte);
+            _kma_write_host(dest + k * byte, GetRef(data), byte);
+        }
+    }
+}
+/* host address of the i-th string element counted from first in DF order */
+#define _kas_bulk_elem(first, i, byte) \
+    (_GetEFLAGS_DF ? ((first) - (i) * (byte)) : ((first) + (i) * (byte)))
+#define VCPUINS_BULK_BLOCK 0x40
+/* index of the first element pair that ends repz/repnz cmps, or n if none */
+static t_nubit32 _kas_bulk_cmps(t_vaddrcc src, t_vaddrcc dest, t_nubit8 byte, t_nubit32 n, t_bool flagz) {
+    t_nubit32 i = 0, block, data1 = 0, data2 = 0;
+    if (flagz) {
+        /* skip over equal blocks, then locate the mismatch element by element */
+        block = VCPUINS_BULK_BLOCK / byte;
+        while (i + block <= n && !MEMCMP(
+                    (void *) _kas_bulk_elem(src, _GetEFLAGS_DF ? (i + block - 1) : i, byte),
+                    (void *) _kas_bulk_elem(dest, _GetEFLAGS_DF ? (i + block - 1) : i, byte),
+                    block * byte)) {
+            i += block;
+        }
+    }
+    for (; i < n; ++i) {
+        _kma_read_host(_kas_bulk_elem(src, i, byte), GetRef(data1), byte);
+        _kma_read_host(_kas_bulk_elem(dest, i, byte), GetRef(data2), byte);
+        if ((data1 == data2) != flagz) return i;
+    }
+    return n;
+}
+/* index of the first element that ends repz/repnz scas, or n if none */
+static t_nubit32 _kas_bulk_scas(t_vaddrcc dest, t_nubit32 data, t_nubit8 byte, t_nubit32 n, t_bool flagz) {
+    t_nubit32 i, cdata = 0;
+    t_vaddrcc found;
+    if (!flagz && byte == 1 && !_GetEFLAGS_DF) {
+        found = (t_vaddrcc) MEMCHR((void *) dest, GetMax8(data), n);
+        return found ? (t_nubit32)(found - dest) : n;
+    }
+    for (i = 0; i < n; ++i) {
+        _kma_read_host(_kas_bulk_elem(dest, i, byte), GetRef(cdata), byte);
+        if ((cdata == data) != flagz) return i;
+    }
+    return n;
+}
 
 #define _kac_arith1(funflag, type8, expr8, type16, expr16, type32, expr32) \
 do { \
@@ -4733,6 +4864,105 @@ static void _m_lods(t_nubit8 byte) {
     }
     _ce;
 }
+/* repeated string instructions run up to VCPUINS_REP_CHUNK elements at once */
+static t_nubit32 _kas_rep_count() {
+    return (_GetAddressSize == 2) ? vcpu.data.cx : vcpu.data.ecx;
+}
+static t_nubit32 _kas_rep_limit() {
+    return _GetEFLAGS_TF ? 1 : VCPUINS_REP_CHUNK;
+}
+static void _m_rep_movs(t_nubit8 byte) {
+    t_nubit32 total = 0, count, n;
+    t_nubit32 cesi, cedi;
+    t_vaddrcc dest;
+    _cb("_m_rep_movs");
+    while ((count = _kas_rep_count()) && total < _kas_rep_limit()) {
+        if (count > _kas_rep_limit() - total) count = _kas_rep_limit() - total;
+        cesi = (_GetAddressSize == 2) ? vcpu.data.si : vcpu.data.esi;
+        cedi = (_GetAddressSize == 2) ? vcpu.data.di : vcpu.data.edi;
+        n = _kas_bulk_count(vcpuins.data.roverds, cesi, byte, count, 0);
+        n = _kas_bulk_count(&vcpu.data.es, cedi, byte, n, 1);
+        if (n) {
+            dest = _kas_bulk_host(&vcpu.data.es, cedi, byte, n);
+            _kas_bulk_movs(dest, _kas_bulk_host(vcpuins.data.roverds, cesi, byte, n), byte, n);
+            vramMarkPhysical(vcpu.data.es.base + (t_nubit32)(dest - vcpu.data.es.hostBase), n * byte);
+            vmachineWatchWrite(vcpu.data.es.base + cedi, vcpuins.data.roverds->base + cesi + n * byte);
+            _kas_bulk_move_index(n, byte, 1, 1);
+        } else {
+            n = 1;
+            vcpuins.data.msize = 0;
+            _chr(_m_movs(byte));
+            _kas_bulk_move_index(1, byte, 0, 0);
+        }
+        total += n;
+        _kul_commit();
+    }
+    if (_kas_rep_count()) vcpuins.data.flagInsLoop = True;
+    _ce;
+}
+static void _m_rep_stos(t_nubit8 byte) {
+    t_nubit32 total = 0, count, n, i;
+    t_nubit32 cedi;
+    t_vaddrcc dest;
+    _cb("_m_rep_stos");
+    while ((count = _kas_rep_count()) && total < _kas_rep_limit()) {
+        if (count > _kas_rep_limit() - total) count = _kas_rep_limit() - total;
+        cedi = (_GetAddressSize == 2) ? vcpu.data.di : vcpu.data.edi;
+        n = _kas_bulk_count(&vcpu.data.es, cedi, byte, count, 1);
+        if (n) {
+            dest = _kas_bulk_host(&vcpu.data.es, cedi, byte, n);
+            if (byte == 1) {
+                MEMSET((void *) dest, vcpu.data.al, n);
+            } else {
+                for (i = 0; i < n; ++i) {
+                    _kma_write_host(dest + i * byte, GetRef(vcpu.data.eax), byte);
+                }
+            }
+            vramMarkPhysical(vcpu.data.es.base + (t_nubit32)(dest - vcpu.data.es.hostBase), n * byte);
+            vmachineWatchWrite(vcpu.data.es.base + cedi, vcpu.data.eax + n * byte);
+            _kas_bulk_move_index(n, byte, 0, 1);
+        } else {
+            n = 1;
+            vcpuins.data.msize = 0;
+            _chr(_m_stos(byte));
+            _kas_bulk_move_index(1, byte, 0, 0);
+        }
+        total += n;
+        _kul_commit();
+    }
+    if (_kas_rep_count()) vcpuins.data.flagInsLoop = True;
+    _ce;
+}
+static void _m_rep_lods(t_nubit8 byte) {
+    t_nubit32 total = 0, count, n;
+    t_nubit32 cesi;
+    _cb("_m_rep_lods");
+    while ((count = _kas_rep_count()) && total < _kas_rep_limit()) {
+        if (count > _kas_rep_limit() - total) count = _kas_rep_limit() - total;
+        cesi = (_GetAddressSize == 2) ? vcpu.data.si : vcpu.data.esi;
+        n = _kas_bulk_count(vcpuins.data.roverds, cesi, byte, count, 0);
+        if (n) {
+            /* only the last element remains in the accumulator */
+            if (_GetEFLAGS_DF) {
+                _kma_read_host(_kas_bulk_host(vcpuins.data.roverds, cesi, byte, n), GetRef(vcpu.data.eax), byte);
+            } else {
+                _kma_read_host(vcpuins.data.roverds->hostBase + cesi + (n - 1) * byte, GetRef(vcpu.data.eax), byte);
+            }
+            vcpuins.data.bit = byte * 8;
+            vcpuins.data.result = (byte == 1) ? vcpu.data.al : ((byte == 2) ? vcpu.data.ax : vcpu.data.eax);
+            _kas_bulk_move_index(n, byte, 1, 0);
+        } else {
+            n = 1;
+            vcpuins.data.msize = 0;
+            _chr(_m_lods(byte));
+            _kas_bulk_move_index(1, byte, 0, 0);
+        }
+        total += n;
+        _kul_commit();
+    }
+    if (_kas_rep_count()) vcpuins.data.flagInsLoop = True;
+    _ce;
+}
 static void _a_cmps(t_nubit8 bit) {
     t_nubit32 cesi, cedi;
     _cb("_a_cmps");
@@ -4847,10 +5077,264 @@ static void _a_scas(t_nubit8 bit) {
     _chr(_kaf_set_flags(CMP_FLAG));
     _ce;
 }
+/* repeated cmps/scas stop at the first element that clears/sets zf */
+static t_bool _kas_rep_zf_done() {
+    return (vcpuins.data.prefix_rep == PREFIX_REP_REPZ && !_GetEFLAGS_ZF) ||
+           (vcpuins.data.prefix_rep == PREFIX_REP_REPZNZ && _GetEFLAGS_ZF);
+}
+static void _a_rep_cmps(t_nubit8 bit) {
+    t_nubit8 byte = bit / 8;
+    t_nubit32 total = 0, count, n, k;
+    t_nubit32 cesi, cedi;
+    t_vaddrcc src, dest;
+    _cb("_a_rep_cmps");
+    while ((count = _kas_rep_count()) && total < _kas_rep_limit()) {
+        if (count > _kas_rep_limit() - total) count = _kas_rep_limit() - total;
+        cesi = (_GetAddressSize == 2) ? vcpu.data.si : vcpu.data.esi;
+        cedi = (_GetAddressSize == 2) ? vcpu.data.di : vcpu.data.edi;
+        n = _kas_bulk_count(vcpuins.data.roverds, cesi, byte, count, 0);
+        n = _kas_bulk_count(&vcpu.data.es, cedi, byte, n, 0);
+        if (n) {
+            src = vcpuins.data.roverds->hostBase + cesi;
+            dest = vcpu.data.es.hostBase + cedi;
+            k = _kas_bulk_cmps(src, dest, byte, n, vcpuins.data.prefix_rep == PREFIX_REP_REPZ);
+            if (k < n) n = k + 1;
+            /* flags come from the last element compared */
+            vcpuins.data.opr1 = 0;
+            vcpuins.data.opr2 = 0;
+            _kma_read_host(_kas_bulk_elem(src, n - 1, byte), GetRef(vcpuins.data.opr1), byte);
+            _kma_read_host(_kas_bulk_elem(dest, n - 1, byte), GetRef(vcpuins.data.opr2), byte);
+            vcpuins.data.bit = bit;
+            vcpuins.data.type = (byte == 1) ? CMP8 : ((byte == 2) ? CMP16 : CMP32);
+            vcpuins.data.result = (t_nubit32)(vcpuins.data.opr1 - vcpuins.data.opr2);
+            if (byte == 1) vcpuins.data.result = GetMax8(vcpuins.data.result);
+            if (byte == 2) vcpuins.data.result = GetMax16(vcpuins.data.result);
+            _chr(_kaf_set_flags(CMP_FLAG));
+            _kas_bulk_move_index(n, byte, 1, 1);
+        } else {
+            n = 1;
+            vcpuins.data.msize = 0;
+            _chr(_a_cmps(bit));
+            _kas_bulk_move_index(1, byte, 0, 0);
+        }
+        total += n;
+        _kul_commit();
+        if (_kas_rep_zf_done()) break;
+    }
+    if (_kas_rep_count() && !_kas_rep_zf_done()) vcpuins.data.flagInsLoop = True;
+    _ce;
+}
+static void _a_rep_scas(t_nubit8 bit) {
+    t_nubit8 byte = bit / 8;
+    t_nubit32 total = 0, count, n, k;
+    t_nubit32 cedi, data;
+    t_vaddrcc dest;
+    _cb("_a_rep_scas");
+    data = (byte == 1) ? vcpu.data.al : ((byte == 2) ? vcpu.data.ax : vcpu.data.eax);
+    while ((count = _kas_rep_count()) && total < _kas_rep_limit()) {
+        if (count > _kas_rep_limit() - total) count = _kas_rep_limit() - total;
+        cedi = (_GetAddressSize == 2) ? vcpu.data.di : vcpu.data.edi;
+        n = _kas_bulk_count(&vcpu.data.es, cedi, byte, count, 0);
+        if (n) {
+            dest = vcpu.data.es.hostBase + cedi;
+            k = _kas_bulk_scas(dest, data, byte, n, vcpuins.data.prefix_rep == PREFIX_REP_REPZ);
+            if (k < n) n = k + 1;
+            /* flags come from the last element scanned */
+            vcpuins.data.opr1 = data;
+            vcpuins.data.opr2 = 0;
+            _kma_read_host(_kas_bulk_elem(dest, n - 1, byte), GetRef(vcpuins.data.opr2), byte);
+            vcpuins.data.bit = bit;
+            vcpuins.data.type = (byte == 1) ? CMP8 : ((byte == 2) ? CMP16 : CMP32);
+            vcpuins.data.result = (t_nubit32)(vcpuins.data.opr1 - vcpuins.data.opr2);
+            if (byte == 1) vcpuins.data.result = GetMax8(vcpuins.data.result);
+            if (byte == 2) vcpuins.data.result = GetMax16(vcpuins.data.result);
+            _chr(_kaf_set_flags(CMP_FLAG));
+            _kas_bulk_move_index(n, byte, 0, 1);
+        } else {
+            n = 1;
+            vcpuins.data.msize = 0;
+            _chr(_a_scas(bit));
+            _kas_bulk_move_index(1, byte, 0, 0);
+        }
+        total += n;
+        _kul_commit();
+        if (_kas_rep_zf_done()) break;
+    }
+    if (_kas_rep_count() && !_kas_rep_zf_done()) vcpuins.data.flagInsLoop = True;
+    _ce;
+}
+/* delay loop unit */
+/* iterations of a loop that only counts a register down are skipped within the
+ * budget of the current block, unless the debugger or a trap has to see each */
+static t_bool _kdl_test(t_nubit8 length) {
+    return vcpuins.data.delayBudget && !_GetEFLAGS_TF && !vcpuins.data.flagWE &&
+           !(vdebug.data.flagBreak && vcpu.data.cs.selector == vdebug.data.breakCS &&
+             GetMax16(vdebug.data.breakIP - vcpuins.data.receip) < length) &&
+           !(vdebug.data.flagBreak32 && vdebug.data.breakLinear - vcpuins.data.linear < length);
+}
+/* loop, loopz or loopnz to itself, with cecx iterations left to run */
+static void _kdl_loop(t_nubit32 cecx) {
+    t_nubit32 skip = cecx - 1;
+    if (!skip || !_kdl_test(1)) return;
+    /* loop leaves flags alone, so the condition holds until the counter ends */
+    if (skip > vcpuins.data.delayBudget) skip = vcpuins.data.delayBudget;
+    if (_GetAddressSize == 2) {
+        vcpu.data.cx = GetMax16(vcpu.data.cx - skip);
+    } else {
+        vcpu.data.ecx -= skip;
+    }
+    vcpuins.data.delayRun = skip;
+    vcpuins.data.delayLoop++;
+    vcpuins.data.delayIns += skip;
+}
+/* dec reg and jnz back to it, after dec has left cdest in register */
+static void _kdl_dec(t_vaddrcc rdest, t_nubit8 bit) {
+    t_nubit32 cdest = (bit == 16) ? d_nubit16(rdest) : d_nubit32(rdest);
+    t_nubit32 skip = cdest - 1;
+    if (!cdest || !skip || vcpuins.data.oplen < 3 || (vcpuins.data.opcodes[0] & 0xf8) != 0x48 ||
+            vcpuins.data.opcodes[1] != 0x75 || vcpuins.data.opcodes[2] != 0xfd || !_kdl_test(3)) {
+        return;
+    }
+    /* each skipped iteration is a taken jnz and a dec */
+    if (skip > vcpuins.data.delayBudget / 2) skip = vcpuins.data.delayBudget / 2;
+    if (!skip) return;
+    /* the last skipped dec leaves the flags */
+    _chr(_a_dec(cdest - skip + 1, bit));
+    if (bit == 16) {
+        d_nubit16(rdest) = GetMax16(vcpuins.data.result);
+    } else {
+        d_nubit32(rdest) = GetMax32(vcpuins.data.result);
+    }
+    vcpuins.data.delayRun = skip * 2;
+    vcpuins.data.delayLoop++;
+    vcpuins.data.delayIns += skip * 2;
+}
+
+/* compare and branch fusion unit */
+/* a jcc right after a compare, test or count runs along with it: the condition
+ * is evaluated from the pending operands, which stay pending for later readers */
+/* keeps fusion for a group opcode only if its modrm reg field selects a compare */
+#define _kfu_test_reg(opcode) \
+    (vcpuins.data.flagFuse = GetBit(vcpuins.connect.fuseTable[(opcode)], 1 << vcpuins.data.cr))
+/* jcc condition cc of status flags */
+static t_bool _kfu_test_flags(t_nubit32 flags, t_nubit8 cc) {
+    t_bool flag;
+    switch (cc >> 1) {
+    case 0: flag = !!(flags & VCPU_EFLAGS_OF); break;
+    case 1: flag = !!(flags & VCPU_EFLAGS_CF); break;
+    case 2: flag = !!(flags & VCPU_EFLAGS_ZF); break;
+    case 3: flag = !!(flags & (VCPU_EFLAGS_CF | VCPU_EFLAGS_ZF)); break;
+    case 4: flag = !!(flags & VCPU_EFLAGS_SF); break;
+    case 5: flag = !!(flags & VCPU_EFLAGS_PF); break;
+    case 6: flag = !(flags & VCPU_EFLAGS_SF) != !(flags & VCPU_EFLAGS_OF); break;
+    default:flag = (flags & VCPU_EFLAGS_ZF) || (!(flags & VCPU_EFLAGS_SF) != !(flags & VCPU_EFLAGS_OF)); break;
+    }
+    return flag ^ (cc & 0x01);
+}
+/* jcc condition cc of current status flags, without materializing them */
+static t_bool _kfu_condition(t_nubit8 cc) {
+    static const t_nubit32 needed[8] = {
+        VCPU_EFLAGS_OF, VCPU_EFLAGS_CF, VCPU_EFLAGS_ZF, VCPU_EFLAGS_CF | VCPU_EFLAGS_ZF,
+        VCPU_EFLAGS_SF, VCPU_EFLAGS_PF, VCPU_EFLAGS_SF | VCPU_EFLAGS_OF,
+        VCPU_EFLAGS_SF | VCPU_EFLAGS_OF | VCPU_EFLAGS_ZF
+    };
+    t_cpu_data_lazy *rlazy = &vcpu.data.lazy;
+    t_nubit32 flags = needed[cc >> 1];
+    t_nubit64 sign;
+    t_bool flag;
+    if ((rlazy->flags & flags) != flags) {
+        /* some flags are already in eflags: merge them with the pending ones */
+        flag = _kfu_test_flags((vcpu.data.eflags & ~rlazy->flags) |
+                               _kaf_calc(rlazy, rlazy->flags & flags), cc);
+    } else if (cc >> 1 == 2) {
+        flag = !rlazy->result ^ (cc & 0x01);
+    } else if (cc >> 1 == 4) {
+        sign = (t_nubit64) 1 << (rlazy->bit - 1);
+        flag = !!(rlazy->result & sign) ^ (cc & 0x01);
+    } else if (cc >> 1 != 0 && cc >> 1 != 5 && (rlazy->type == SUB8 || rlazy->type == SUB16 ||
+               rlazy->type == SUB32 || rlazy->type == CMP8 || rlazy->type == CMP16 || rlazy->type == CMP32)) {
+        /* unsigned or signed order of the operands */
+        sign = (t_nubit64) 1 << (rlazy->bit - 1);
+        switch (cc >> 1) {
+        case 1: flag = rlazy->opr1 < rlazy->opr2; break;
+        case 3: flag = rlazy->opr1 <= rlazy->opr2; break;
+        case 6: flag = (rlazy->opr1 ^ sign) < (rlazy->opr2 ^ sign); break;
+        default:flag = (rlazy->opr1 ^ sign) <= (rlazy->opr2 ^ sign); break;
+        }
+        flag ^= cc & 0x01;
+    } else {
+        flag = _kfu_test_flags(_kaf_calc(rlazy, flags), cc);
+    }
+#if VCPUINS_LAZY_CHECK == 1
+    if (flag != _kfu_test_flags(vcpu.data.eflags, cc)) {
+        PRINTF("Fused condition mismatch at L%08x: TYPE=%d, CC=%x, EAGER=%d, FUSED=%d\n",
+               vcpuins.data.linear, rlazy->type, cc, !flag, flag);
+        deviceStop();
+    }
+#endif
+    return flag;
+}
+/* if cs:offset to cs:offset+byte-1 pass the fetch checks loaded with cs */
+static t_bool _kfu_test_cs(t_nubit32 offset, t_nubit8 byte) {
+    t_cpu_data_sreg *rsreg = &vcpu.data.cs;
+    if (rsreg->accMode != _GetAccessMode || !GetBit(rsreg->accPerm, _GetAccessPerm(0, 1))) return False;
+    if (rsreg->accFlat) return offset <= GetMax32(Max32 - (byte - 1));
+    return GetMax32(offset - rsreg->accLower) <= rsreg->accSpan - (byte - 1);
+}
+/* runs the jcc at cs:eip as part of the instruction just executed; anything the
+ * debugger, a trap, an interrupt or a fault would see in between is left alone */
+static void _kfu_jcc() {
+    t_nubit32 index, neweip, rel;
+    t_nubit8 cc, length, *rcode;
+    t_cpuins_data_fetch *rentry = &vcpuins.data.fcache[vcpuins.data.linear % VCPUINS_FCACHE_SIZE];
+    index = GetMax32(vcpu.data.cs.base + vcpu.data.eip - vcpuins.data.linear);
+    if (index >= vcpuins.data.oplen || vcpuins.data.oplen - index < 2) return;
+    rcode = vcpuins.data.opcodes + index;
+    if ((rcode[0] & 0xf0) == 0x70) {
+        cc = rcode[0] & 0x0f;
+        length = 2;
+        rel = (t_nubit32)(t_nsbit32)(t_nsbit8) rcode[1];
+    } else if (rcode[0] == 0x0f && (rcode[1] & 0xf0) == 0x80) {
+        cc = rcode[1] & 0x0f;
+        length = vcpu.data.cs.seg.exec.defsize ? 6 : 4;
+        if (vcpuins.data.oplen - index < length) return;
+        if (length == 4) {
+            rel = (t_nubit32)(t_nsbit32)(t_nsbit16)(rcode[2] | (rcode[3] << 8));
+        } else {
+            rel = (t_nubit32) rcode[2] | ((t_nubit32) rcode[3] << 8) |
+                  ((t_nubit32) rcode[4] << 16) | ((t_nubit32) rcode[5] << 24);
+        }
+    } else {
+        return;
+    }
+    /* the instruction may have written over the jcc */
+    if (!rentry->flagValid || rentry->linear != vcpuins.data.linear ||
+            rentry->ver1 != VRAM_GetVersion(rentry->phy1) ||
+            rentry->ver2 != VRAM_GetVersion(rentry->phy2)) {
+        return;
+    }
+    if (vcpuins.data.delayRun >= vcpuins.data.delayBudget || !device.flagRun ||
+            _GetEFLAGS_TF || vcpuins.data.flagWE || vcpu.data.flagNMI ||
+            (_GetEFLAGS_IF && vpicScanINTR()) ||
+            (vdebug.data.flagBreak && vcpu.data.cs.selector == vdebug.data.breakCS &&
+             vcpu.data.ip == vdebug.data.breakIP) ||
+            (vdebug.data.flagBreak32 && vcpu.data.cs.base + vcpu.data.eip == vdebug.data.breakLinear)) {
+        return;
+    }
+    neweip = vcpu.data.eip + length;
+    if (_kfu_condition(cc)) neweip += rel;
+    if (!vcpu.data.cs.seg.exec.defsize) neweip = GetMax16(neweip);
+    /* faults are raised by the jcc on its own */
+    if (!_kfu_test_cs(vcpu.data.eip, length) || !_kfu_test_cs(neweip, 1)) return;
+    vcpu.data.eip = neweip;
+    vcpuins.data.delayRun++;
+    vcpuins.data.fuseIns++;
+}
+
 #define _adv _chr(_d_skip(1))
 static void UndefinedOpcode() {
     _cb("UndefinedOpcode");
-    vcpu = vcpuins.data.oldcpu;
+    _kul_rollback();
     if (!_GetCR0_PE) {
         PRINTF("The NXVM CPU has encountered an illegal instruction at L%08X.\n", vcpu.data.cs.base + vcpu.data.eip);
         deviceStop();
@@ -5144,6 +5628,8 @@ static void INS_0F() {
     i386(0x0f) {
         _adv;
         _chr(_s_read_cs(vcpu.data.eip, GetRef(opcode), 1));
+        vcpuins.data.flagLazy = vcpuins.connect.lazyTable_0f[opcode];
+        if (!vcpuins.data.flagLazy) _kaf_sync(vcpu.data.lazy.flags);
         _chr(ExecFun(vcpuins.connect.insTable_0f[opcode]));
     }
     else
@@ -6250,12 +6736,14 @@ static void DEC_EAX() {
             _bb("OperandSize(2)");
             _chr(_a_dec(vcpu.data.ax, 16));
             vcpu.data.ax = GetMax16(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.ax), 16));
             _be;
             break;
         case 4:
             _bb("OperandSize(4)");
             _chr(_a_dec(vcpu.data.eax, 32));
             vcpu.data.eax = GetMax32(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.eax), 32));
             _be;
             break;
         default:
@@ -6279,12 +6767,14 @@ static void DEC_ECX() {
             _bb("OperandSize(2)");
             _chr(_a_dec(vcpu.data.cx, 16));
             vcpu.data.cx = GetMax16(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.cx), 16));
             _be;
             break;
         case 4:
             _bb("OperandSize(4)");
             _chr(_a_dec(vcpu.data.ecx, 32));
             vcpu.data.ecx = GetMax32(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.ecx), 32));
             _be;
             break;
         default:
@@ -6308,12 +6798,14 @@ static void DEC_EDX() {
             _bb("OperandSize(2)");
             _chr(_a_dec(vcpu.data.dx, 16));
             vcpu.data.dx = GetMax16(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.dx), 16));
             _be;
             break;
         case 4:
             _bb("OperandSize(4)");
             _chr(_a_dec(vcpu.data.edx, 32));
             vcpu.data.edx = GetMax32(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.edx), 32));
             _be;
             break;
         default:
@@ -6337,12 +6829,14 @@ static void DEC_EBX() {
             _bb("OperandSize(2)");
             _chr(_a_dec(vcpu.data.bx, 16));
             vcpu.data.bx = GetMax16(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.bx), 16));
             _be;
             break;
         case 4:
             _bb("OperandSize(4)");
             _chr(_a_dec(vcpu.data.ebx, 32));
             vcpu.data.ebx = GetMax32(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.ebx), 32));
             _be;
             break;
         default:
@@ -6366,12 +6860,14 @@ static void DEC_ESP() {
             _bb("OperandSize(2)");
             _chr(_a_dec(vcpu.data.sp, 16));
             vcpu.data.sp = GetMax16(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.sp), 16));
             _be;
             break;
         case 4:
             _bb("OperandSize(4)");
             _chr(_a_dec(vcpu.data.esp, 32));
             vcpu.data.esp = GetMax32(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.esp), 32));
             _be;
             break;
         default:
@@ -6395,12 +6891,14 @@ static void DEC_EBP() {
             _bb("OperandSize(2)");
             _chr(_a_dec(vcpu.data.bp, 16));
             vcpu.data.bp = GetMax16(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.bp), 16));
             _be;
             break;
         case 4:
             _bb("OperandSize(4)");
             _chr(_a_dec(vcpu.data.ebp, 32));
             vcpu.data.ebp = GetMax32(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.ebp), 32));
             _be;
             break;
         default:
@@ -6424,12 +6922,14 @@ static void DEC_ESI() {
             _bb("OperandSize(2)");
             _chr(_a_dec(vcpu.data.si, 16));
             vcpu.data.si = GetMax16(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.si), 16));
             _be;
             break;
         case 4:
             _bb("OperandSize(4)");
             _chr(_a_dec(vcpu.data.esi, 32));
             vcpu.data.esi = GetMax32(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.esi), 32));
             _be;
             break;
         default:
@@ -6453,12 +6953,14 @@ static void DEC_EDI() {
             _bb("OperandSize(2)");
             _chr(_a_dec(vcpu.data.di, 16));
             vcpu.data.di = GetMax16(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.di), 16));
             _be;
             break;
         case 4:
             _bb("OperandSize(4)");
             _chr(_a_dec(vcpu.data.edi, 32));
             vcpu.data.edi = GetMax32(vcpuins.data.result);
+            _chr(_kdl_dec(GetRef(vcpu.data.edi), 32));
             _be;
             break;
         default:
@@ -7065,6 +7567,7 @@ static void PREFIX_OprSize() {
     i386(0x66) {
         _adv;
         vcpuins.data.prefix_oprsize = True;
+        _kdf_select_table();
     }
     else
         UndefinedOpcode();
@@ -7513,6 +8016,7 @@ static void INS_80() {
         vcpu.data.ip++;
     }
     _chr(_d_modrm(0, 1));
+    _kfu_test_reg(0x80);
     _chr(_d_imm(1));
     _chr(_m_read_rm(1));
     switch (vcpuins.data.cr) {
@@ -7582,6 +8086,7 @@ static void INS_81() {
     i386(0x81) {
         _adv;
         _chr(_d_modrm(0, _GetOperandSize));
+        _kfu_test_reg(0x81);
         _chr(_d_imm(_GetOperandSize));
         _chr(_m_read_rm(_GetOperandSize));
         switch (vcpuins.data.cr) {
@@ -7648,6 +8153,7 @@ static void INS_81() {
     else {
         vcpu.data.ip++;
         _chr(_d_modrm(0, 2));
+        _kfu_test_reg(0x81);
         _chr(_d_imm(2));
         _chr(_m_read_rm(2));
         switch (vcpuins.data.cr) {
@@ -7719,6 +8225,7 @@ static void INS_83() {
     i386(0x83) {
         _adv;
         _chr(_d_modrm(0, _GetOperandSize));
+        _kfu_test_reg(0x83);
         _chr(_d_imm(1));
         _chr(_m_read_rm(_GetOperandSize));
         bit = (_GetOperandSize * 8 + 8) >> 1;
@@ -7785,6 +8292,7 @@ static void INS_83() {
     else {
         vcpu.data.ip++;
         _chr(_d_modrm(0, 2));
+        _kfu_test_reg(0x83);
         _chr(_d_imm(1));
         _chr(_m_read_rm(2));
         bit = 12;
@@ -8724,33 +9232,7 @@ static void MOVSB() {
             _be;
         } else {
             _bb("prefix_rep(!PREFIX_REP_NONE)");
-            switch (_GetAddressSize) {
-            case 2:
-                _bb("AddressSize(2)");
-                if (vcpu.data.cx) {
-                    _bb("cx(!0)");
-                    _chr(_m_movs(1));
-                    vcpu.data.cx--;
-                    _be;
-                }
-                if (vcpu.data.cx) vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            case 4:
-                _bb("AddressSize(4)");
-                if (vcpu.data.ecx) {
-                    _bb("ecx(!0)");
-                    _chr(_m_movs(1));
-                    vcpu.data.ecx--;
-                    _be;
-                }
-                if (vcpu.data.ecx) vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
+            _chr(_m_rep_movs(1));
             _be;
         }
     }
@@ -8777,33 +9259,7 @@ static void MOVSW() {
             _be;
         } else {
             _bb("prefix_rep(!PREFIX_REP_NONE)");
-            switch (_GetAddressSize) {
-            case 2:
-                _bb("AddressSize(2)");
-                if (vcpu.data.cx) {
-                    _bb("cx(!0)");
-                    _chr(_m_movs(_GetOperandSize));
-                    vcpu.data.cx--;
-                    _be;
-                }
-                if (vcpu.data.cx) vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            case 4:
-                _bb("AddressSize(4)");
-                if (vcpu.data.ecx) {
-                    _bb("ecx(!0)");
-                    _chr(_m_movs(_GetOperandSize));
-                    vcpu.data.ecx--;
-                    _be;
-                }
-                if (vcpu.data.ecx) vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
+            _chr(_m_rep_movs(_GetOperandSize));
             _be;
         }
     }
@@ -8830,39 +9286,7 @@ static void CMPSB() {
             _be;
         } else {
             _bb("prefix_rep(!PREFIX_REP_NONE)");
-            switch (_GetAddressSize) {
-            case 2:
-                _bb("AddressSize(2)");
-                if (vcpu.data.cx) {
-                    _bb("cx(!0)");
-                    _chr(_a_cmps(8));
-                    vcpu.data.cx--;
-                    _be;
-                }
-                if (vcpu.data.cx &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZ && !_GetEFLAGS_ZF) &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZNZ && _GetEFLAGS_ZF))
-                    vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            case 4:
-                _bb("AddressSize(4)");
-                if (vcpu.data.ecx) {
-                    _bb("ecx(!0)");
-                    _chr(_a_cmps(8));
-                    vcpu.data.ecx--;
-                    _be;
-                }
-                if (vcpu.data.ecx &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZ && !_GetEFLAGS_ZF) &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZNZ && _GetEFLAGS_ZF))
-                    vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
+            _chr(_a_rep_cmps(8));
             _be;
         }
     }
@@ -8892,39 +9316,7 @@ static void CMPSW() {
             _be;
         } else {
             _bb("prefix_rep(!PREFIX_REP_NONE)");
-            switch (_GetAddressSize) {
-            case 2:
-                _bb("AddressSize(2)");
-                if (vcpu.data.cx) {
-                    _bb("cx(!0)");
-                    _chr(_a_cmps(_GetOperandSize * 8));
-                    vcpu.data.cx--;
-                    _be;
-                }
-                if (vcpu.data.cx &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZ && !_GetEFLAGS_ZF) &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZNZ && _GetEFLAGS_ZF))
-                    vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            case 4:
-                _bb("AddressSize(4)");
-                if (vcpu.data.ecx) {
-                    _bb("ecx(!0)");
-                    _chr(_a_cmps(_GetOperandSize * 8));
-                    vcpu.data.ecx--;
-                    _be;
-                }
-                if (vcpu.data.ecx &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZ && !_GetEFLAGS_ZF) &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZNZ && _GetEFLAGS_ZF))
-                    vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
+            _chr(_a_rep_cmps(_GetOperandSize * 8));
             _be;
         }
     }
@@ -8996,33 +9388,7 @@ static void STOSB() {
             _be;
         } else {
             _bb("prefix_rep(!PREFIX_REP_NONE)");
-            switch (_GetAddressSize) {
-            case 2:
-                _bb("AddressSize(2)");
-                if (vcpu.data.cx) {
-                    _bb("cx(!0)");
-                    _chr(_m_stos(1));
-                    vcpu.data.cx--;
-                    _be;
-                }
-                if (vcpu.data.cx) vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            case 4:
-                _bb("AddressSize(4)");
-                if (vcpu.data.ecx) {
-                    _bb("ecx(!0)");
-                    _chr(_m_stos(1));
-                    vcpu.data.ecx--;
-                    _be;
-                }
-                if (vcpu.data.ecx) vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
+            _chr(_m_rep_stos(1));
             _be;
         }
     }
@@ -9049,33 +9415,7 @@ static void STOSW() {
             _be;
         } else {
             _bb("prefix_rep(!PREFIX_REP_NONE)");
-            switch (_GetAddressSize) {
-            case 2:
-                _bb("AddressSize(2)");
-                if (vcpu.data.cx) {
-                    _bb("cx(!0)");
-                    _chr(_m_stos(_GetOperandSize));
-                    vcpu.data.cx--;
-                    _be;
-                }
-                if (vcpu.data.cx) vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            case 4:
-                _bb("AddressSize(4)");
-                if (vcpu.data.ecx) {
-                    _bb("ecx(!0)");
-                    _chr(_m_stos(_GetOperandSize));
-                    vcpu.data.ecx--;
-                    _be;
-                }
-                if (vcpu.data.ecx) vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
+            _chr(_m_rep_stos(_GetOperandSize));
             _be;
         }
     }
@@ -9102,33 +9442,7 @@ static void LODSB() {
             _be;
         } else {
             _bb("prefix_rep(!PREFIX_REP_NONE)");
-            switch (_GetAddressSize) {
-            case 2:
-                _bb("AddressSize(2)");
-                if (vcpu.data.cx) {
-                    _bb("cx(!0)");
-                    _chr(_m_lods(1));
-                    vcpu.data.cx--;
-                    _be;
-                }
-                if (vcpu.data.cx) vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            case 4:
-                _bb("AddressSize(4)");
-                if (vcpu.data.ecx) {
-                    _bb("ecx(!0)");
-                    _chr(_m_lods(1));
-                    vcpu.data.ecx--;
-                    _be;
-                }
-                if (vcpu.data.ecx) vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
+            _chr(_m_rep_lods(1));
             _be;
         }
     }
@@ -9155,33 +9469,7 @@ static void LODSW() {
             _be;
         } else {
             _bb("prefix_rep(!PREFIX_REP_NONE)");
-            switch (_GetAddressSize) {
-            case 2:
-                _bb("AddressSize(2)");
-                if (vcpu.data.cx) {
-                    _bb("cx(!0)");
-                    _chr(_m_lods(_GetOperandSize));
-                    vcpu.data.cx--;
-                    _be;
-                }
-                if (vcpu.data.cx) vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            case 4:
-                _bb("AddressSize(4)");
-                if (vcpu.data.ecx) {
-                    _bb("ecx(!0)");
-                    _chr(_m_lods(_GetOperandSize));
-                    vcpu.data.ecx--;
-                    _be;
-                }
-                if (vcpu.data.ecx) vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
+            _chr(_m_rep_lods(_GetOperandSize));
             _be;
         }
     }
@@ -9208,39 +9496,7 @@ static void SCASB() {
             _be;
         } else {
             _bb("prefix_rep(!PREFIX_REP_NONE)");
-            switch (_GetAddressSize) {
-            case 2:
-                _bb("AddressSize(2)");
-                if (vcpu.data.cx) {
-                    _bb("cx(!0)");
-                    _chr(_a_scas(8));
-                    vcpu.data.cx--;
-                    _be;
-                }
-                if (vcpu.data.cx &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZ && !_GetEFLAGS_ZF) &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZNZ && _GetEFLAGS_ZF))
-                    vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            case 4:
-                _bb("AddressSize(4)");
-                if (vcpu.data.ecx) {
-                    _bb("ecx(!0)");
-                    _chr(_a_scas(8));
-                    vcpu.data.ecx--;
-                    _be;
-                }
-                if (vcpu.data.ecx &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZ && !_GetEFLAGS_ZF) &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZNZ && _GetEFLAGS_ZF))
-                    vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
+            _chr(_a_rep_scas(8));
             _be;
         }
     }
@@ -9270,39 +9526,7 @@ static void SCASW() {
             _be;
         } else {
             _bb("prefix_rep(!PREFIX_REP_NONE)");
-            switch (_GetAddressSize) {
-            case 2:
-                _bb("AddressSize(2)");
-                if (vcpu.data.cx) {
-                    _bb("cx(!0)");
-                    _chr(_a_scas(_GetOperandSize * 8));
-                    vcpu.data.cx--;
-                    _be;
-                }
-                if (vcpu.data.cx &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZ && !_GetEFLAGS_ZF) &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZNZ && _GetEFLAGS_ZF))
-                    vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            case 4:
-                _bb("AddressSize(4)");
-                if (vcpu.data.ecx) {
-                    _bb("ecx(!0)");
-                    _chr(_a_scas(_GetOperandSize * 8));
-                    vcpu.data.ecx--;
-                    _be;
-                }
-                if (vcpu.data.ecx &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZ && !_GetEFLAGS_ZF) &&
-                        !(vcpuins.data.prefix_rep == PREFIX_REP_REPZNZ && _GetEFLAGS_ZF))
-                    vcpuins.data.flagInsLoop = True;
-                _be;
-                break;
-            default:
-                _impossible_r_;
-                break;
-            }
+            _chr(_a_rep_scas(_GetOperandSize * 8));
             _be;
         }
     }
@@ -11072,7 +11296,7 @@ static void HLT() {
     _new_code_path_;
     if (_GetCR0_PE && _GetCPL) {
         _bb("CR0_PE(1),CPL(!0)");
-        _SetExcept_GP(0);
+        _chr(_SetExcept_GP(0));
         _be;
     }
     _adv;
@@ -11100,6 +11324,7 @@ static void INS_F6() {
         vcpu.data.ip++;
     }
     _chr(_d_modrm(0, 1));
+    _kfu_test_reg(0xf6);
     _chr(_m_read_rm(1));
     switch (vcpuins.data.cr) {
     case 0: /* TEST_RM8_I8 */
@@ -11159,6 +11384,7 @@ static void INS_F7() {
     i386(0xf7) {
         _adv;
         _chr(_d_modrm(0, _GetOperandSize));
+        _kfu_test_reg(0xf7);
         _chr(_m_read_rm(_GetOperandSize));
         switch (vcpuins.data.cr) {
         case 0: /* TEST_RM32_I32 */
@@ -11214,6 +11440,7 @@ static void INS_F7() {
     else {
         vcpu.data.ip++;
         _chr(_d_modrm(0, 2));
+        _kfu_test_reg(0xf7);
         _chr(_m_read_rm(2));
         switch (vcpuins.data.cr) {
         case 0: /* TEST_RM16_I16 */
@@ -11392,6 +11619,7 @@ static void INS_FE() {
         vcpu.data.ip++;
     }
     _chr(_d_modrm(0, 1));
+    _kfu_test_reg(0xfe);
     _chr(_m_read_rm(1));
     switch (vcpuins.data.cr) {
     case 0: /* INC_RM8 */
@@ -12532,13 +12760,16 @@ static void CLTS() {
     _new_code_path_;
     _adv;
     if (!_GetCR0_PE) {
+        _kul_save_reg(&vcpu.data.cr0);
         _ClrCR0_TS;
     } else {
         _bb("CR0_PE(1)");
-        if (_GetCPL > 0)
+        if (_GetCPL > 0) {
             _chr(_SetExcept_GP(0));
-        else
+        } else {
+            _kul_save_reg(&vcpu.data.cr0);
             _ClrCR0_TS;
+        }
         _be;
     }
     _ce;
@@ -12583,7 +12814,17 @@ static void MOV_CR_R32() {
         _be;
     }
     _chr(_d_modrm_creg());
+    _kul_save_reg((t_nubit32 *)vcpuins.data.rr);
     _chr(_m_write_ref(vcpuins.data.rr, GetRef(vcpuins.data.crm), 4));
+    if (vcpuins.data.rr == (t_vaddrcc)&vcpu.data.cr0 ||
+            vcpuins.data.rr == (t_vaddrcc)&vcpu.data.cr3) {
+        _kfc_flush();
+    }
+    if (vcpuins.data.rr == (t_vaddrcc)&vcpu.data.cr3 ||
+            (vcpuins.data.rr == (t_vaddrcc)&vcpu.data.cr0 &&
+             ((vcpuins.data.cr ^ vcpu.data.cr0) & (VCPU_CR0_PE | VCPU_CR0_PG)))) {
+        _kma_flush_tlb();
+    }
     /* if (vcpuins.data.rr == (t_vaddrcc)&vcpu.data.cr0) {
         PRINTF("MOV_CR_R32: executed at L%08X, CR0=%08X\n", vcpuins.data.linear, vcpu.data.cr0);
     }
@@ -12605,6 +12846,7 @@ static void MOV_DR_R32() {
         _be;
     }
     _chr(_d_modrm_dreg());
+    _kul_save_reg((t_nubit32 *)vcpuins.data.rr);
     _chr(_m_write_ref(vcpuins.data.rr, GetRef(vcpuins.data.crm), 4));
     _ce;
 }
@@ -12631,6 +12873,7 @@ static void MOV_TR_R32() {
         _be;
     }
     _chr(_d_modrm_treg());
+    _kul_save_reg((t_nubit32 *)vcpuins.data.rr);
     _chr(_m_write_ref(vcpuins.data.rr, GetRef(vcpuins.data.crm), 4));
     _ce;
 }
@@ -13258,25 +13501,194 @@ static void MOVSX_R32_RM16() {
     _ce;
 }
 
+/* handlers instantiated with constant operand size for specialized tables */
+#define _kdf_spec_incdec(name, op, reg16, reg32, size) \
+static void name() { \
+    _cb(#name); \
+    _adv; \
+    if ((size) == 2) { \
+        _chr(op(vcpu.data.reg16, 16)); \
+        vcpu.data.reg16 = GetMax16(vcpuins.data.result); \
+    } else { \
+        _chr(op(vcpu.data.reg32, 32)); \
+        vcpu.data.reg32 = GetMax32(vcpuins.data.result); \
+    } \
+    _ce; \
+}
+#define _kdf_spec_dec(name, op, reg16, reg32, size) \
+static void name() { \
+    _cb(#name); \
+    _adv; \
+    if ((size) == 2) { \
+        _chr(op(vcpu.data.reg16, 16)); \
+        vcpu.data.reg16 = GetMax16(vcpuins.data.result); \
+        _chr(_kdl_dec(GetRef(vcpu.data.reg16), 16)); \
+    } else { \
+        _chr(op(vcpu.data.reg32, 32)); \
+        vcpu.data.reg32 = GetMax32(vcpuins.data.result); \
+        _chr(_kdl_dec(GetRef(vcpu.data.reg32), 32)); \
+    } \
+    _ce; \
+}
+#define _kdf_spec_stack(name, op, reg16, reg32, size) \
+static void name() { \
+    _cb(#name); \
+    _adv; \
+    if ((size) == 2) { \
+        _chr(op(GetRef(vcpu.data.reg16), 2)); \
+    } else { \
+        _chr(op(GetRef(vcpu.data.reg32), 4)); \
+    } \
+    _ce; \
+}
+#define _kdf_spec_mov_imm(name, reg16, reg32, size) \
+static void name() { \
+    _cb(#name); \
+    _adv; \
+    _chr(_d_imm(size)); \
+    if ((size) == 2) { \
+        vcpu.data.reg16 = GetMax16(vcpuins.data.cimm); \
+    } else { \
+        vcpu.data.reg32 = GetMax32(vcpuins.data.cimm); \
+    } \
+    _ce; \
+}
+#define _kdf_spec_arith_rm_r(name, op, flagwrite, size) \
+static void name() { \
+    _cb(#name); \
+    _adv; \
+    _chr(_d_modrm((size), (size))); \
+    _chr(_m_read_rm(size)); \
+    _chr(op(vcpuins.data.crm, vcpuins.data.cr, (size) * 8)); \
+    if (flagwrite) { \
+        vcpuins.data.crm = vcpuins.data.result; \
+        _chr(_m_write_rm(size)); \
+    } \
+    _ce; \
+}
+#define _kdf_spec_arith_r_rm(name, op, flagwrite, size) \
+static void name() { \
+    _cb(#name); \
+    _adv; \
+    _chr(_d_modrm((size), (size))); \
+    _chr(_m_read_rm(size)); \
+    _chr(op(vcpuins.data.cr, vcpuins.data.crm, (size) * 8)); \
+    if (flagwrite) { \
+        _chr(_m_write_ref(vcpuins.data.rr, GetRef(vcpuins.data.result), (size))); \
+    } \
+    _ce; \
+}
+#define _kdf_spec_pair(macro, name, ...) \
+    macro(name##_O16, __VA_ARGS__, 2) \
+    macro(name##_O32, __VA_ARGS__, 4)
+
+_kdf_spec_pair(_kdf_spec_incdec, INC_EAX, _a_inc, ax, eax)
+_kdf_spec_pair(_kdf_spec_incdec, INC_ECX, _a_inc, cx, ecx)
+_kdf_spec_pair(_kdf_spec_incdec, INC_EDX, _a_inc, dx, edx)
+_kdf_spec_pair(_kdf_spec_incdec, INC_EBX, _a_inc, bx, ebx)
+_kdf_spec_pair(_kdf_spec_incdec, INC_ESP, _a_inc, sp, esp)
+_kdf_spec_pair(_kdf_spec_incdec, INC_EBP, _a_inc, bp, ebp)
+_kdf_spec_pair(_kdf_spec_incdec, INC_ESI, _a_inc, si, esi)
+_kdf_spec_pair(_kdf_spec_incdec, INC_EDI, _a_inc, di, edi)
+_kdf_spec_pair(_kdf_spec_dec, DEC_EAX, _a_dec, ax, eax)
+_kdf_spec_pair(_kdf_spec_dec, DEC_ECX, _a_dec, cx, ecx)
+_kdf_spec_pair(_kdf_spec_dec, DEC_EDX, _a_dec, dx, edx)
+_kdf_spec_pair(_kdf_spec_dec, DEC_EBX, _a_dec, bx, ebx)
+_kdf_spec_pair(_kdf_spec_dec, DEC_ESP, _a_dec, sp, esp)
+_kdf_spec_pair(_kdf_spec_dec, DEC_EBP, _a_dec, bp, ebp)
+_kdf_spec_pair(_kdf_spec_dec, DEC_ESI, _a_dec, si, esi)
+_kdf_spec_pair(_kdf_spec_dec, DEC_EDI, _a_dec, di, edi)
+_kdf_spec_pair(_kdf_spec_stack, PUSH_EAX, _e_push, ax, eax)
+_kdf_spec_pair(_kdf_spec_stack, PUSH_ECX, _e_push, cx, ecx)
+_kdf_spec_pair(_kdf_spec_stack, PUSH_EDX, _e_push, dx, edx)
+_kdf_spec_pair(_kdf_spec_stack, PUSH_EBX, _e_push, bx, ebx)
+_kdf_spec_pair(_kdf_spec_stack, PUSH_ESP, _e_push, sp, esp)
+_kdf_spec_pair(_kdf_spec_stack, PUSH_EBP, _e_push, bp, ebp)
+_kdf_spec_pair(_kdf_spec_stack, PUSH_ESI, _e_push, si, esi)
+_kdf_spec_pair(_kdf_spec_stack, PUSH_EDI, _e_push, di, edi)
+_kdf_spec_pair(_kdf_spec_stack, POP_EAX, _e_pop, ax, eax)
+_kdf_spec_pair(_kdf_spec_stack, POP_ECX, _e_pop, cx, ecx)
+_kdf_spec_pair(_kdf_spec_stack, POP_EDX, _e_pop, dx, edx)
+_kdf_spec_pair(_kdf_spec_stack, POP_EBX, _e_pop, bx, ebx)
+_kdf_spec_pair(_kdf_spec_stack, POP_ESP, _e_pop, sp, esp)
+_kdf_spec_pair(_kdf_spec_stack, POP_EBP, _e_pop, bp, ebp)
+_kdf_spec_pair(_kdf_spec_stack, POP_ESI, _e_pop, si, esi)
+_kdf_spec_pair(_kdf_spec_stack, POP_EDI, _e_pop, di, edi)
+_kdf_spec_pair(_kdf_spec_mov_imm, MOV_EAX_I32, ax, eax)
+_kdf_spec_pair(_kdf_spec_mov_imm, MOV_ECX_I32, cx, ecx)
+_kdf_spec_pair(_kdf_spec_mov_imm, MOV_EDX_I32, dx, edx)
+_kdf_spec_pair(_kdf_spec_mov_imm, MOV_EBX_I32, bx, ebx)
+_kdf_spec_pair(_kdf_spec_mov_imm, MOV_ESP_I32, sp, esp)
+_kdf_spec_pair(_kdf_spec_mov_imm, MOV_EBP_I32, bp, ebp)
+_kdf_spec_pair(_kdf_spec_mov_imm, MOV_ESI_I32, si, esi)
+_kdf_spec_pair(_kdf_spec_mov_imm, MOV_EDI_I32, di, edi)
+_kdf_spec_pair(_kdf_spec_arith_rm_r, ADD_RM32_R32, _a_add, 1)
+_kdf_spec_pair(_kdf_spec_arith_r_rm, ADD_R32_RM32, _a_add, 1)
+_kdf_spec_pair(_kdf_spec_arith_rm_r, OR_RM32_R32, _a_or, 1)
+_kdf_spec_pair(_kdf_spec_arith_r_rm, OR_R32_RM32, _a_or, 1)
+_kdf_spec_pair(_kdf_spec_arith_rm_r, ADC_RM32_R32, _a_adc, 1)
+_kdf_spec_pair(_kdf_spec_arith_r_rm, ADC_R32_RM32, _a_adc, 1)
+_kdf_spec_pair(_kdf_spec_arith_rm_r, SBB_RM32_R32, _a_sbb, 1)
+_kdf_spec_pair(_kdf_spec_arith_r_rm, SBB_R32_RM32, _a_sbb, 1)
+_kdf_spec_pair(_kdf_spec_arith_rm_r, AND_RM32_R32, _a_and, 1)
+_kdf_spec_pair(_kdf_spec_arith_r_rm, AND_R32_RM32, _a_and, 1)
+_kdf_spec_pair(_kdf_spec_arith_rm_r, SUB_RM32_R32, _a_sub, 1)
+_kdf_spec_pair(_kdf_spec_arith_r_rm, SUB_R32_RM32, _a_sub, 1)
+_kdf_spec_pair(_kdf_spec_arith_rm_r, XOR_RM32_R32, _a_xor, 1)
+_kdf_spec_pair(_kdf_spec_arith_r_rm, XOR_R32_RM32, _a_xor, 1)
+_kdf_spec_pair(_kdf_spec_arith_rm_r, CMP_RM32_R32, _a_cmp, 0)
+_kdf_spec_pair(_kdf_spec_arith_r_rm, CMP_R32_RM32, _a_cmp, 0)
+
+/* handlers for real and virtual-8086 mode tables */
+static void POP_ES_REAL() {
+    t_nubit32 xs_sel;
+    _cb("POP_ES_REAL");
+    _adv;
+    _chr(_e_pop(GetRef(xs_sel), _GetOperandSize));
+    _ksa_load_sreg_real(&vcpu.data.es, GetMax16(xs_sel));
+    _ce;
+}
+static void POP_DS_REAL() {
+    t_nubit32 xs_sel;
+    _cb("POP_DS_REAL");
+    _adv;
+    _chr(_e_pop(GetRef(xs_sel), _GetOperandSize));
+    _ksa_load_sreg_real(&vcpu.data.ds, GetMax16(xs_sel));
+    _ce;
+}
+static void MOV_SREG_RM16_REAL() {
+    _cb("MOV_SREG_RM16_REAL");
+    _adv;
+    _chr(_d_modrm_sreg(2));
+    if (vcpuins.data.rmovsreg->sregtype == SREG_CODE) {
+        _bb("sregtype(SREG_CODE)");
+        _chr(_SetExcept_UD(0));
+        _be;
+    }
+    _chr(_m_read_rm(2));
+    _ksa_load_sreg_real(vcpuins.data.rmovsreg, GetMax16(vcpuins.data.crm));
+    if (vcpuins.data.rmovsreg->sregtype == SREG_STACK)
+        vcpuins.data.flagMaskInt = True;
+    _ce;
+}
+
 static void ExecInit() {
     vcpuins.data.flagIgnore = False;
     vcpuins.data.msize = 0;
     vcpuins.data.reccs = vcpu.data.cs.selector;
     vcpuins.data.receip = vcpu.data.eip;
     vcpuins.data.linear = vcpu.data.cs.base + vcpu.data.eip;
-    if (vcpuinsReadLinear(vcpuins.data.linear, (t_vaddrcc) vcpuins.data.opcodes, 15)) {
-        vcpuins.data.oplen = 0;
-    } else {
-        vcpuins.data.oplen = 15;
-    }
+    _kfc_fetch();
 
     vcpuins.data.flagLock = False;
-    vcpuins.data.oldcpu = vcpu;
+    _kul_init();
     vcpuins.data.roverds = &vcpu.data.ds;
     vcpuins.data.roverss = &vcpu.data.ss;
     vcpuins.data.prefix_rep = PREFIX_REP_NONE;
     vcpuins.data.prefix_oprsize = False;
     vcpuins.data.prefix_addrsize = False;
+    vcpuins.data.rinsTable = vcpuins.connect.insTableSpec[_GetSpecMode |
+        (vcpu.data.cs.seg.exec.defsize ? VCPUINS_SPEC_OPR32 : 0)];
     vcpuins.data.flagMem = False;
     vcpuins.data.flagInsLoop = False;
     vcpuins.data.flagMaskInt = False;
@@ -13285,6 +13697,8 @@ static void ExecInit() {
     vcpuins.data.opr2 = 0;
     vcpuins.data.result = 0;
     vcpuins.data.udf = Zero32;
+    vcpuins.data.flagLazy = False;
+    vcpuins.data.flagFuse = False;
     vcpuins.data.mrm.rsreg = NULL;
     vcpuins.data.mrm.offset = Zero32;
     vcpuins.data.except = Zero32;
@@ -13295,39 +13709,135 @@ static void ExecInit() {
 }
 static void ExecFinal() {
     if (vcpuins.data.flagInsLoop) {
-        vcpu.data.cs = vcpuins.data.oldcpu.data.cs;
-        vcpu.data.eip = vcpuins.data.oldcpu.data.eip;
+        _kul_restore_sreg(&vcpu.data.cs);
+        vcpu.data.eip = vcpuins.data.undo.eip;
     }
 #if VCPUINS_TRACE == 1
-    if (trace.callCount && !vcpuins.data.except) _SetExcept_CE(trace.cid);
+    if (trace.callCount && !vcpuins.data.except) _SetExcept_CE((t_nubit32) trace.callCount);
     utilsTraceFinal(&trace);
 #endif
     if (vcpuins.data.except) {
-        vcpu = vcpuins.data.oldcpu;
+        _kul_rollback();
         if (GetBit(vcpuins.data.except, VCPUINS_EXCEPT_GP)) {
+            _kaf_sync(vcpu.data.lazy.flags);
             ExecInit();
             ClrBit(vcpuins.data.except, VCPUINS_EXCEPT_GP);
+            _kfj_try
             _e_except_n(0x0d, _GetOperandSize);
+            _kfj_end
         }
         deviceStop();
     }
 }
+#if VCPUINS_DISPATCH_GOTO == 1
+/* opcode tables are fully populated, so handlers are called unchecked */
+#define _kdf_call(faddr) ((*(void (*)(void))(faddr))())
+static void ExecIns() {
+    static void *label[0x100];
+    t_nubit8 opcode = 0;
+    t_nubitcc i;
+    if (!label[0x00]) {
+        for (i = 0; i < 0x100; ++i) label[i] = &&ins;
+        label[0x0f] = &&ins_0f;
+        label[0x26] = &&prefix_es;
+        label[0x2e] = &&prefix_cs;
+        label[0x36] = &&prefix_ss;
+        label[0x3e] = &&prefix_ds;
+        label[0x64] = &&prefix_fs;
+        label[0x65] = &&prefix_gs;
+        label[0x66] = &&prefix_oprsize;
+        label[0x67] = &&prefix_addrsize;
+        label[0xf0] = &&prefix_lock;
+        label[0xf2] = &&prefix_repnz;
+        label[0xf3] = &&prefix_repz;
+    }
+    ExecInit();
+    _kfj_try
+    do {
+        _cb("ExecIns");
+next:
+        _chb(_s_read_cs(vcpu.data.eip, GetRef(opcode), 1));
+        goto *label[opcode];
+prefix_es:
+        vcpuins.data.roverds = vcpuins.data.roverss = &vcpu.data.es;
+        goto prefix;
+prefix_cs:
+        vcpuins.data.roverds = vcpuins.data.roverss = &vcpu.data.cs;
+        goto prefix;
+prefix_ss:
+        vcpuins.data.roverds = vcpuins.data.roverss = &vcpu.data.ss;
+        goto prefix;
+prefix_ds:
+        vcpuins.data.roverds = vcpuins.data.roverss = &vcpu.data.ds;
+        goto prefix;
+prefix_fs:
+        vcpuins.data.roverds = vcpuins.data.roverss = &vcpu.data.fs;
+        goto prefix;
+prefix_gs:
+        vcpuins.data.roverds = vcpuins.data.roverss = &vcpu.data.gs;
+        goto prefix;
+prefix_oprsize:
+        vcpuins.data.prefix_oprsize = True;
+        _kdf_select_table();
+        goto prefix;
+prefix_addrsize:
+        vcpuins.data.prefix_addrsize = True;
+        goto prefix;
+prefix_repnz:
+        vcpuins.data.prefix_rep = PREFIX_REP_REPZNZ;
+        goto prefix;
+prefix_repz:
+        vcpuins.data.prefix_rep = PREFIX_REP_REPZ;
+        goto prefix;
+prefix_lock:
+        /* lock validates the instruction it prefixes */
+        _chb(PREFIX_LOCK());
+        goto next;
+prefix:
+        vcpu.data.eip++;
+        goto next;
+ins_0f:
+        vcpu.data.eip++;
+        _chb(_s_read_cs(vcpu.data.eip, GetRef(opcode), 1));
+        vcpuins.data.flagLazy = vcpuins.connect.lazyTable_0f[opcode];
+        if (!vcpuins.data.flagLazy) _kaf_sync(vcpu.data.lazy.flags);
+        _chb(_kdf_call(vcpuins.connect.insTable_0f[opcode]));
+        goto test;
+ins:
+        vcpuins.data.flagLazy = vcpuins.connect.lazyTable[opcode];
+        vcpuins.data.flagFuse = !!vcpuins.connect.fuseTable[opcode];
+        if (!vcpuins.data.flagLazy) _kaf_sync(vcpu.data.lazy.flags);
+        _chb(_kdf_call(vcpuins.data.rinsTable[opcode]));
+test:
+        _chb(_s_test_eip());
+        _chb(_s_test_esp());
+        _ce;
+    } while (0);
+    _kfj_end
+#else
 static void ExecIns() {
     t_nubit8 opcode = 0;
     ExecInit();
+    _kfj_try
     do {
         _cb("ExecIns");
         _chb(_s_read_cs(vcpu.data.eip, GetRef(opcode), 1));
-        _chb(ExecFun(vcpuins.connect.insTable[opcode]));
+        vcpuins.data.flagLazy = vcpuins.connect.lazyTable[opcode];
+        vcpuins.data.flagFuse = !!vcpuins.connect.fuseTable[opcode];
+        if (!vcpuins.data.flagLazy) _kaf_sync(vcpu.data.lazy.flags);
+        _chb(ExecFun(vcpuins.data.rinsTable[opcode]));
         _chb(_s_test_eip());
         _chb(_s_test_esp());
         _ce;
     } while (_kdf_check_prefix(opcode));
+    _kfj_end
+#endif
     if (vcpuins.data.flagWE && vcpuins.data.weLinear == vcpuins.data.linear) {
         PRINTF("Watch point caught at L%08x: EXECUTED\n", vcpuins.data.linear);
         /* printCpuReg(); */
         deviceStop();
     }
+    if (vcpuins.data.flagFuse && !vcpuins.data.except) _kfu_jcc();
     ExecFinal();
 }
 static void ExecInt() {
@@ -13335,35 +13845,573 @@ static void ExecInt() {
     /* hardware interrupt handler */
     if (vcpuins.data.flagMaskInt)
         return;
+    if (!vcpu.data.flagNMI && !vpicScanINTR() && !_GetEFLAGS_TF)
+        return;
     if (!vcpu.data.flagMaskNMI && vcpu.data.flagNMI) {
         vcpu.data.flagHalt = False;
         vcpu.data.flagNMI = False;
+        _kaf_sync(vcpu.data.lazy.flags);
         ExecInit();
+        _kfj_try
         _e_intr_n(0x02, _GetOperandSize);
+        _kfj_end
         ExecFinal();
     }
     if (_GetEFLAGS_IF && vpicScanINTR()) {
         vcpu.data.flagHalt = False;
         intr = vpicGetINTR();
+        _kaf_sync(vcpu.data.lazy.flags);
         ExecInit();
+        _kfj_try
         _e_intr_n(intr, _GetOperandSize);
+        _kfj_end
         ExecFinal();
         vcpuins.data.flagIgnore = True;
     }
     if (_GetEFLAGS_TF) {
         vcpu.data.flagHalt = False;
+        _kaf_sync(vcpu.data.lazy.flags);
         ExecInit();
+        _kfj_try
         _e_intr_n(0x01, _GetOperandSize);
+        _kfj_end
         ExecFinal();
     }
 }
 
+#if VCPUINS_JIT == 1
+/* host code translation unit */
+/* translated blocks hold register-only instructions; anything touching
+   memory, ports, segments or the stack is left to the interpreter */
+#define VCPUINS_JIT_ALU  0x00 /* add, or, adc, sbb, and, sub, xor, cmp */
+#define VCPUINS_JIT_TEST 0x01
+#define VCPUINS_JIT_INC  0x02
+#define VCPUINS_JIT_DEC  0x03
+#define VCPUINS_JIT_MOV  0x04
+#define VCPUINS_JIT_XCHG 0x05
+#define VCPUINS_JIT_CLC  0x06
+#define VCPUINS_JIT_STC  0x07
+#define VCPUINS_JIT_CMC  0x08
+#define VCPUINS_JIT_NOP  0x09
+#define VCPUINS_JIT_JCC  0x0a
+#define VCPUINS_JIT_JMP  0x0b
+#define LOGIC_FLAG (AND_FLAG | VCPU_EFLAGS_OF | VCPU_EFLAGS_CF)
+/* host code offset of guest register from vcpu */
+static t_nubit32 _kjt_reg(t_nubit8 reg, t_nubit8 bit) {
+    t_vaddrcc addr;
+    switch (bit == 8 ? (reg & 0x03) : reg) {
+    case 0: addr = GetRef(vcpu.data.eax); break;
+    case 1: addr = GetRef(vcpu.data.ecx); break;
+    case 2: addr = GetRef(vcpu.data.edx); break;
+    case 3: addr = GetRef(vcpu.data.ebx); break;
+    case 4: addr = GetRef(vcpu.data.esp); break;
+    case 5: addr = GetRef(vcpu.data.ebp); break;
+    case 6: addr = GetRef(vcpu.data.esi); break;
+    default:addr = GetRef(vcpu.data.edi); break;
+    }
+    if (bit == 8 && reg > 3) addr++;
+    return (t_nubit32) (addr - GetRef(vcpu));
+}
+static t_nubit8 *_kjt_byte(t_nubit8 *p, t_nubit8 byte) {
+    *p = byte;
+    return p + 1;
+}
+static t_nubit8 *_kjt_dword(t_nubit8 *p, t_nubit32 dword) {
+    p[0] = GetMax8(dword);
+    p[1] = GetMax8(dword >> 8);
+    p[2] = GetMax8(dword >> 16);
+    p[3] = GetMax8(dword >> 24);
+    return p + 4;
+}
+/* modrm and displacement of [rbx + offset] with host register reg */
+static t_nubit8 *_kjt_rbx(t_nubit8 *p, t_nubit8 reg, t_nubit32 offset) {
+    p = _kjt_byte(p, 0x83 | (reg << 3));
+    return _kjt_dword(p, offset);
+}
+/* loads guest register into host eax (0) or ecx (1), zero extended */
+static t_nubit8 *_kjt_load(t_nubit8 *p, t_nubit8 hreg, t_nubit8 reg, t_nubit8 bit) {
+    switch (bit) {
+    case 8:
+        p = _kjt_byte(_kjt_byte(p, 0x0f), 0xb6);
+        break;
+    case 16:
+        p = _kjt_byte(_kjt_byte(p, 0x0f), 0xb7);
+        break;
+    default:
+        p = _kjt_byte(p, 0x8b);
+        break;
+    }
+    return _kjt_rbx(p, hreg, _kjt_reg(reg, bit));
+}
+/* stores host eax (0) or ecx (1) into guest register */
+static t_nubit8 *_kjt_store(t_nubit8 *p, t_nubit8 hreg, t_nubit8 reg, t_nubit8 bit) {
+    switch (bit) {
+    case 8:
+        p = _kjt_byte(p, 0x88);
+        break;
+    case 16:
+        p = _kjt_byte(_kjt_byte(p, 0x66), 0x89);
+        break;
+    default:
+        p = _kjt_byte(p, 0x89);
+        break;
+    }
+    return _kjt_rbx(p, hreg, _kjt_reg(reg, bit));
+}
+/* merges host status flags selected by mask into guest eflags */
+static t_nubit8 *_kjt_capture(t_nubit8 *p, t_nubit32 mask) {
+    t_nubit32 offset = (t_nubit32) (GetRef(vcpu.data.eflags) - GetRef(vcpu));
+    p = _kjt_byte(_kjt_byte(p, 0x9c), 0x5a);               /* pushfq; pop rdx */
+    p = _kjt_dword(_kjt_byte(_kjt_byte(p, 0x81), 0xe2), mask);  /* and edx, mask */
+    p = _kjt_rbx(_kjt_byte(p, 0x8b), 1, offset);           /* mov ecx, eflags */
+    p = _kjt_dword(_kjt_byte(_kjt_byte(p, 0x81), 0xe1), ~mask); /* and ecx, ~mask */
+    p = _kjt_byte(_kjt_byte(p, 0x09), 0xd1);               /* or ecx, edx */
+    return _kjt_rbx(_kjt_byte(p, 0x89), 1, offset);        /* mov eflags, ecx */
+}
+static t_nubit8 *_kjt_qword(t_nubit8 *p, t_nubit64 qword) {
+    return _kjt_dword(_kjt_dword(p, (t_nubit32) qword), (t_nubit32) (qword >> 32));
+}
+/* displacement of host address from vcpu */
+#define _kjt_off(addr) ((t_nubit32) ((addr) - GetRef(vcpu)))
+/* layout of the exit stub that chains a block to its successor */
+#define VCPUINS_JIT_PROLOGUE 0x0b /* push rbx; mov rbx, vcpu */
+#define VCPUINS_JIT_PTR  0x12 /* address of successor page version */
+#define VCPUINS_JIT_VER  0x1c /* successor page version */
+#define VCPUINS_JIT_REL  0x27 /* jump to successor body */
+#define VCPUINS_JIT_OUT  0x2b /* return to the interpreter */
+#define VCPUINS_JIT_STUB 0x4f
+/* stores eip and leaves through a stub that is linked to the successor later */
+static t_nubit8 *_kjt_exit(t_nubit8 *p, t_cpuins_data_jit *rentry, t_nubit32 eip) {
+    t_nubit8 *stub;
+    p = _kjt_rbx(_kjt_byte(p, 0xc7), 0, _kjt_off(GetRef(vcpu.data.eip)));
+    p = _kjt_dword(p, eip); /* mov eip, imm */
+    stub = p;
+    p = _kjt_rbx(_kjt_byte(p, 0x81), 5, _kjt_off(GetRef(vcpuins.data.jitBudget)));
+    p = _kjt_dword(p, rentry->nins); /* sub budget, nins */
+    p = _kjt_dword(_kjt_byte(_kjt_byte(p, 0x0f), 0x86), VCPUINS_JIT_OUT - 0x10);  /* jbe out */
+    p = _kjt_qword(_kjt_byte(_kjt_byte(p, 0x48), 0xb8), GetRef(vcpu.data.eip));   /* mov rax, ptr */
+    p = _kjt_dword(_kjt_byte(_kjt_byte(p, 0x81), 0x38), 0);                       /* cmp [rax], ver */
+    p = _kjt_dword(_kjt_byte(_kjt_byte(p, 0x0f), 0x85), VCPUINS_JIT_OUT - 0x26);  /* jne out */
+    p = _kjt_dword(_kjt_byte(p, 0xe9), 0);                                        /* jmp out */
+    p = _kjt_qword(_kjt_byte(_kjt_byte(p, 0x48), 0xb8), (t_nubit64) (t_vaddrcc) stub);
+    p = _kjt_rbx(_kjt_byte(_kjt_byte(p, 0x48), 0x89), 0, _kjt_off(GetRef(vcpuins.data.jitLink)));
+    p = _kjt_qword(_kjt_byte(_kjt_byte(p, 0x48), 0xb8), (t_nubit64) (t_vaddrcc) rentry);
+    p = _kjt_rbx(_kjt_byte(_kjt_byte(p, 0x48), 0x89), 0, _kjt_off(GetRef(vcpuins.data.jitLinkEntry)));
+    return _kjt_byte(_kjt_byte(p, 0x5b), 0xc3); /* pop rbx; ret */
+}
+/* points exit stub to the body of a translated block */
+static void _kjt_link(t_nubit8 *stub, t_cpuins_data_jit *rentry) {
+    t_nubit8 *body = (t_nubit8 *) rentry->code + VCPUINS_JIT_PROLOGUE;
+    if (d_nubit32(stub + VCPUINS_JIT_REL) == (t_nubit32) (body - (stub + VCPUINS_JIT_OUT)) &&
+            d_nubit32(stub + VCPUINS_JIT_VER) == rentry->version) {
+        return;
+    }
+    _kjt_qword(stub + VCPUINS_JIT_PTR, (t_nubit64) GetRef(VRAM_GetVersion(rentry->linear)));
+    _kjt_dword(stub + VCPUINS_JIT_VER, rentry->version);
+    _kjt_dword(stub + VCPUINS_JIT_REL, (t_nubit32) (body - (stub + VCPUINS_JIT_OUT)));
+    vcpuins.data.jitChain++;
+}
+/* decodes one instruction at eip; returns its length or 0 if not translatable */
+static t_nubit8 _kjt_decode(t_cpuins_jit_ins *rins, t_nubit8 *code, t_nubit32 eip, t_nubit32 left) {
+    t_nubit32 i = 0;
+    t_nubit8 opcode, modrm = 0;
+    t_bool flag32 = vcpu.data.cs.seg.exec.defsize;
+    MEMSET((void *) rins, Zero8, sizeof(t_cpuins_jit_ins));
+    if (!left) return 0;
+    if (code[i] == 0x66) {
+        flag32 = !flag32;
+        if (++i == left) return 0;
+    }
+    opcode = code[i++];
+    rins->bit = flag32 ? 32 : 16;
+    /* modrm forms accept register operands only */
+    if ((opcode < 0x40 && (opcode & 0x07) < 0x04) || opcode == 0x80 ||
+            opcode == 0x81 || opcode == 0x83 || (opcode >= 0x84 && opcode <= 0x8b &&
+                    opcode != 0x86 && opcode != 0x87)) {
+        if (i == left) return 0;
+        modrm = code[i++];
+        if ((modrm & 0xc0) != 0xc0) return 0;
+    }
+    if (opcode < 0x40 && (opcode & 0x07) < 0x06) {
+        rins->kind = VCPUINS_JIT_ALU;
+        rins->op = opcode >> 3;
+        if (!(opcode & 0x01)) rins->bit = 8;
+        switch (opcode & 0x07) {
+        case 0:
+        case 1:
+            rins->dest = modrm & 0x07;
+            rins->src = (modrm >> 3) & 0x07;
+            break;
+        case 2:
+        case 3:
+            rins->dest = (modrm >> 3) & 0x07;
+            rins->src = modrm & 0x07;
+            break;
+        default:
+            rins->dest = 0;
+            rins->flagImm = True;
+            break;
+        }
+    } else if (opcode >= 0x80 && opcode <= 0x83 && opcode != 0x82) {
+        rins->kind = VCPUINS_JIT_ALU;
+        rins->op = (modrm >> 3) & 0x07;
+        rins->dest = modrm & 0x07;
+        rins->flagImm = True;
+        if (opcode == 0x80) rins->bit = 8;
+    } else if (opcode == 0x84 || opcode == 0x85 || opcode == 0xa8 || opcode == 0xa9) {
+        rins->kind = VCPUINS_JIT_TEST;
+        if (!(opcode & 0x01)) rins->bit = 8;
+        rins->flagImm = (opcode >= 0xa8);
+        rins->dest = rins->flagImm ? 0 : (modrm & 0x07);
+        rins->src = (modrm >> 3) & 0x07;
+    } else if (opcode >= 0x40 && opcode < 0x50) {
+        rins->kind = (opcode < 0x48) ? VCPUINS_JIT_INC : VCPUINS_JIT_DEC;
+        rins->dest = opcode & 0x07;
+    } else if (opcode >= 0x88 && opcode <= 0x8b) {
+        rins->kind = VCPUINS_JIT_MOV;
+        if (!(opcode & 0x01)) rins->bit = 8;
+        rins->dest = (opcode & 0x02) ? ((modrm >> 3) & 0x07) : (modrm & 0x07);
+        rins->src = (opcode & 0x02) ? (modrm & 0x07) : ((modrm >> 3) & 0x07);
+    } else if (opcode >= 0xb0 && opcode < 0xc0) {
+        rins->kind = VCPUINS_JIT_MOV;
+        if (opcode < 0xb8) rins->bit = 8;
+        rins->dest = opcode & 0x07;
+        rins->flagImm = True;
+    } else if (opcode == 0x90) {
+        rins->kind = VCPUINS_JIT_NOP;
+    } else if (opcode > 0x90 && opcode < 0x98) {
+        rins->kind = VCPUINS_JIT_XCHG;
+        rins->dest = 0;
+        rins->src = opcode & 0x07;
+        if (rins->src == 4) return 0;
+    } else if (opcode == 0xf5) {
+        rins->kind = VCPUINS_JIT_CMC;
+    } else if (opcode == 0xf8) {
+        rins->kind = VCPUINS_JIT_CLC;
+    } else if (opcode == 0xf9) {
+        rins->kind = VCPUINS_JIT_STC;
+    } else if ((opcode >= 0x70 && opcode < 0x80) || opcode == 0xeb) {
+        if (i > 1) return 0;
+        rins->kind = (opcode == 0xeb) ? VCPUINS_JIT_JMP : VCPUINS_JIT_JCC;
+        rins->op = opcode & 0x0f;
+        rins->flagImm = True;
+        rins->bit = 8;
+    } else {
+        return 0;
+    }
+    if (rins->flagImm) {
+        switch ((opcode == 0x83 || rins->kind >= VCPUINS_JIT_JCC) ? 8 : rins->bit) {
+        case 8:
+            if (i + 1 > left) return 0;
+            rins->imm = (opcode == 0x83 || rins->kind >= VCPUINS_JIT_JCC) ?
+                (t_nubit32) (t_nsbit32) (t_nsbit8) code[i] : code[i];
+            i += 1;
+            break;
+        case 16:
+            if (i + 2 > left) return 0;
+            rins->imm = code[i] | (code[i + 1] << 8);
+            i += 2;
+            break;
+        default:
+            if (i + 4 > left) return 0;
+            rins->imm = code[i] | (code[i + 1] << 8) | (code[i + 2] << 16) |
+                ((t_nubit32) code[i + 3] << 24);
+            i += 4;
+            break;
+        }
+    }
+    /* stack pointer changes stay with the interpreter */
+    if (rins->bit != 8 && rins->dest == 4 &&
+            (rins->kind == VCPUINS_JIT_INC || rins->kind == VCPUINS_JIT_DEC ||
+             rins->kind == VCPUINS_JIT_MOV ||
+             (rins->kind == VCPUINS_JIT_ALU && rins->op != 0x07))) {
+        return 0;
+    }
+    switch (rins->kind) {
+    case VCPUINS_JIT_ALU:
+        switch (rins->op) {
+        case 0x02:
+        case 0x03:
+            rins->read = VCPU_EFLAGS_CF;
+            rins->write = ADD_FLAG;
+            break;
+        case 0x01:
+        case 0x04:
+        case 0x06:
+            rins->write = LOGIC_FLAG;
+            break;
+        default:
+            rins->write = ADD_FLAG;
+            break;
+        }
+        break;
+    case VCPUINS_JIT_TEST:
+        rins->write = LOGIC_FLAG;
+        break;
+    case VCPUINS_JIT_INC:
+    case VCPUINS_JIT_DEC:
+        rins->write = INC_FLAG;
+        break;
+    case VCPUINS_JIT_CLC:
+    case VCPUINS_JIT_STC:
+        rins->write = VCPU_EFLAGS_CF;
+        break;
+    case VCPUINS_JIT_CMC:
+        rins->read = VCPU_EFLAGS_CF;
+        rins->write = VCPU_EFLAGS_CF;
+        break;
+    case VCPUINS_JIT_JCC:
+        rins->read = ADD_FLAG;
+        break;
+    default:
+        break;
+    }
+    rins->next = eip + i;
+    if (rins->kind >= VCPUINS_JIT_JCC) {
+        rins->target = rins->next + rins->imm;
+        if (!flag32) rins->target = GetMax16(rins->target);
+        if (rins->target > vcpu.data.cs.limit) return 0;
+    }
+    return (t_nubit8) i;
+}
+/* emits host code of one decoded instruction */
+static t_nubit8 *_kjt_emit(t_nubit8 *p, t_cpuins_data_jit *rentry, t_cpuins_jit_ins *rins) {
+    t_nubit32 eflags = (t_nubit32) (GetRef(vcpu.data.eflags) - GetRef(vcpu));
+    t_nubit8 bit = rins->bit;
+    switch (rins->kind) {
+    case VCPUINS_JIT_ALU:
+    case VCPUINS_JIT_TEST:
+        p = _kjt_load(p, 0, rins->dest, bit);
+        if (rins->flagImm) {
+            p = _kjt_dword(_kjt_byte(p, 0xb9), rins->imm); /* mov ecx, imm */
+        } else {
+            p = _kjt_load(p, 1, rins->src, bit);
+        }
+        if (rins->kind == VCPUINS_JIT_ALU && (rins->op == 0x02 || rins->op == 0x03)) {
+            /* bt dword [eflags], 0 */
+            p = _kjt_byte(_kjt_rbx(_kjt_byte(_kjt_byte(p, 0x0f), 0xba), 4, eflags), 0x00);
+        }
+        if (bit == 16) p = _kjt_byte(p, 0x66);
+        p = _kjt_byte(p, (rins->kind == VCPUINS_JIT_TEST ? 0x84 : (rins->op << 3)) |
+                      (bit == 8 ? 0x00 : 0x01));
+        p = _kjt_byte(p, 0xc8); /* op eax, ecx */
+        if (rins->capture) p = _kjt_capture(p, rins->capture);
+        if (rins->kind == VCPUINS_JIT_ALU && rins->op != 0x07) {
+            p = _kjt_store(p, 0, rins->dest, bit);
+        }
+        break;
+    case VCPUINS_JIT_INC:
+    case VCPUINS_JIT_DEC:
+        p = _kjt_load(p, 0, rins->dest, bit);
+        if (bit == 16) p = _kjt_byte(p, 0x66);
+        p = _kjt_byte(p, bit == 8 ? 0xfe : 0xff);
+        p = _kjt_byte(p, rins->kind == VCPUINS_JIT_INC ? 0xc0 : 0xc8);
+        if (rins->capture) p = _kjt_capture(p, rins->capture);
+        p = _kjt_store(p, 0, rins->dest, bit);
+        break;
+    case VCPUINS_JIT_MOV:
+        if (rins->flagImm) {
+            p = _kjt_dword(_kjt_byte(p, 0xb8), rins->imm); /* mov eax, imm */
+        } else {
+            p = _kjt_load(p, 0, rins->src, bit);
+        }
+        p = _kjt_store(p, 0, rins->dest, bit);
+        break;
+    case VCPUINS_JIT_XCHG:
+        p = _kjt_load(p, 0, rins->dest, bit);
+        p = _kjt_load(p, 1, rins->src, bit);
+        p = _kjt_store(p, 1, rins->dest, bit);
+        p = _kjt_store(p, 0, rins->src, bit);
+        break;
+    case VCPUINS_JIT_CLC:
+        p = _kjt_byte(_kjt_rbx(_kjt_byte(p, 0x83), 4, eflags), 0xfe); /* and */
+        break;
+    case VCPUINS_JIT_STC:
+        p = _kjt_byte(_kjt_rbx(_kjt_byte(p, 0x83), 1, eflags), 0x01); /* or */
+        break;
+    case VCPUINS_JIT_CMC:
+        p = _kjt_byte(_kjt_rbx(_kjt_byte(p, 0x83), 6, eflags), 0x01); /* xor */
+        break;
+    case VCPUINS_JIT_JCC:
+        p = _kjt_rbx(_kjt_byte(p, 0x8b), 1, eflags);                   /* mov ecx, eflags */
+        p = _kjt_dword(_kjt_byte(_kjt_byte(p, 0x81), 0xe1), ADD_FLAG); /* and ecx, flags */
+        p = _kjt_byte(_kjt_byte(p, 0x51), 0x9d);                       /* push rcx; popfq */
+        p = _kjt_byte(_kjt_byte(p, 0x70 | rins->op), 0x0a + VCPUINS_JIT_STUB); /* jcc taken */
+        p = _kjt_exit(p, rentry, rins->next);
+        p = _kjt_exit(p, rentry, rins->target);
+        break;
+    case VCPUINS_JIT_JMP:
+        p = _kjt_exit(p, rentry, rins->target);
+        break;
+    default:
+        break;
+    }
+    return p;
+}
+/* discards all translated blocks */
+static void _kjt_flush() {
+    t_nubitcc i;
+    for (i = 0; i < VCPUINS_JIT_SIZE; ++i) {
+        vcpuins.data.jit[i].flagValid = False;
+    }
+    vcpuins.data.jitUsed = 0;
+    vcpuins.data.jitLink = 0;
+    vcpuins.data.jitVersion = vram.connect.pVersion;
+    vcpuins.data.jitFlush++;
+}
+/* translates the block at entry into host code */
+static void _kjt_translate(t_cpuins_data_jit *rentry) {
+    t_cpuins_jit_ins ins[VCPUINS_JIT_INS];
+    t_nubit8 *code, *p, len;
+    t_nubit32 i, n, eip, left, live, length;
+    if (VRAM_WrapA20(rentry->linear) >= vram.connect.size || rentry->eip > vcpu.data.cs.limit) return;
+    code = (t_nubit8 *) VRAM_GetAddr(rentry->linear);
+    left = _GetPageSize - _GetLinear_Offset(rentry->linear);
+    if (vcpu.data.cs.limit - rentry->eip < left - 1) left = vcpu.data.cs.limit - rentry->eip + 1;
+    if (!vcpu.data.cs.seg.exec.defsize && 0x10000 - rentry->eip < left)
+        left = 0x10000 - rentry->eip;
+    /* decodes straight-line code up to the first branch */
+    n = 0;
+    length = 0;
+    eip = rentry->eip;
+    while (n < VCPUINS_JIT_INS) {
+        len = _kjt_decode(&ins[n], code + length, eip, left - length);
+        if (!len) break;
+        length += len;
+        eip += len;
+        if (ins[n++].kind >= VCPUINS_JIT_JCC) break;
+    }
+    if (!n) return;
+    /* status flags are only captured if read before being redefined */
+    live = ADD_FLAG;
+    for (i = n; i > 0; --i) {
+        ins[i - 1].capture = ins[i - 1].write & live;
+        live = (live & ~ins[i - 1].write) | ins[i - 1].read;
+    }
+    if (vcpuins.data.jitUsed + VCPUINS_JIT_BLOCK + length > VCPUINS_JIT_CODE) {
+        _kjt_flush();
+        rentry->flagValid = True;
+    }
+    p = (t_nubit8 *) (vcpuins.connect.jitCode + vcpuins.data.jitUsed);
+    rentry->code = (t_vaddrcc) p;
+    p = _kjt_byte(p, 0x53); /* push rbx */
+    p = _kjt_qword(_kjt_byte(_kjt_byte(p, 0x48), 0xbb), (t_nubit64) GetRef(vcpu)); /* mov rbx, vcpu */
+    /* linked blocks enter here */
+    p = _kjt_rbx(_kjt_byte(p, 0x81), 0, _kjt_off(GetRef(vcpuins.data.jitRun)));
+    p = _kjt_dword(p, n); /* add run, n */
+    rentry->nins = n;
+    for (i = 0; i < n; ++i) {
+        p = _kjt_emit(p, rentry, &ins[i]);
+    }
+    if (ins[n - 1].kind < VCPUINS_JIT_JCC) p = _kjt_exit(p, rentry, eip);
+    rentry->guest = (t_vaddrcc) p;
+    MEMCPY((void *) rentry->guest, (void *) code, length);
+    rentry->length = length;
+    vcpuins.data.jitUsed = (t_nubit32) (rentry->guest + length - vcpuins.connect.jitCode);
+    vcpuins.data.jitBlock++;
+}
+/* if exit stub the last chain left by may jump straight into entry */
+static t_bool _kjt_check_link(t_cpuins_data_jit *rentry) {
+    t_cpuins_data_jit *rpred = (t_cpuins_data_jit *) vcpuins.data.jitLinkEntry;
+    t_vaddrcc stub = vcpuins.data.jitLink;
+    return rpred->flagValid && rpred->code && stub > rpred->code && stub < rpred->guest &&
+           d_nubit32(stub - 4) == rentry->eip &&
+           rpred->linear - rpred->eip == rentry->linear - rentry->eip &&
+           rpred->cslimit == rentry->cslimit && rpred->defsize == rentry->defsize &&
+           rpred->flagA20 == rentry->flagA20;
+}
+/* runs translated blocks from cs:eip, following linked exits for up to budget instructions;
+   returns False if the interpreter should run */
+static t_bool _kjt_exec(t_nubit32 budget) {
+    t_nubit32 linear = vcpu.data.cs.base + vcpu.data.eip;
+    t_cpuins_data_jit *rentry = &vcpuins.data.jit[linear % VCPUINS_JIT_SIZE];
+    if (!vcpuins.connect.jitCode || _IsPaging || _GetEFLAGS_TF || vcpuins.data.flagWE ||
+            vdebug.data.flagTrace || vdebug.connect.recordFile) {
+        return False;
+    }
+    if (vcpuins.data.jitVersion != vram.connect.pVersion) _kjt_flush();
+    if (rentry->flagValid && rentry->linear == linear && rentry->eip == vcpu.data.eip &&
+            rentry->cslimit == vcpu.data.cs.limit &&
+            rentry->defsize == vcpu.data.cs.seg.exec.defsize &&
+            rentry->flagA20 == vram.data.flagA20 && rentry->version != VRAM_GetVersion(linear)) {
+        /* page is written: keeps the block if its own bytes are unchanged */
+        if (rentry->code && !MEMCMP((void *) VRAM_GetAddr(linear), (void *) rentry->guest, rentry->length)) {
+            rentry->version = VRAM_GetVersion(linear);
+        } else {
+            rentry->flagValid = False;
+        }
+    }
+    if (!rentry->flagValid || rentry->linear != linear || rentry->eip != vcpu.data.eip ||
+            rentry->cslimit != vcpu.data.cs.limit ||
+            rentry->defsize != vcpu.data.cs.seg.exec.defsize ||
+            rentry->flagA20 != vram.data.flagA20 || rentry->version != VRAM_GetVersion(linear)) {
+        rentry->flagValid = True;
+        rentry->linear = linear;
+        rentry->eip = vcpu.data.eip;
+        rentry->cslimit = vcpu.data.cs.limit;
+        rentry->defsize = vcpu.data.cs.seg.exec.defsize;
+        rentry->flagA20 = vram.data.flagA20;
+        rentry->version = VRAM_GetVersion(linear);
+        rentry->count = 0;
+        rentry->code = 0;
+    }
+    if (!rentry->code) {
+        /* each block is translated once; failures are not retried */
+        if (rentry->count == VCPUINS_JIT_HOT) _kjt_translate(rentry);
+        if (rentry->count <= VCPUINS_JIT_HOT) rentry->count++;
+        if (!rentry->code) return False;
+    }
+    if (vcpuins.data.jitLink) {
+        if (_kjt_check_link(rentry)) _kjt_link((t_nubit8 *) vcpuins.data.jitLink, rentry);
+        vcpuins.data.jitLink = 0;
+    }
+    if (vdebug.data.flagBreak || vdebug.data.flagBreak32) {
+        /* break point is only checked in the first block */
+        if ((vdebug.data.flagBreak && vcpu.data.cs.selector == vdebug.data.breakCS &&
+                GetMax16(vdebug.data.breakIP - vcpu.data.ip) < rentry->length) ||
+                (vdebug.data.flagBreak32 && vdebug.data.breakLinear - linear < rentry->length)) {
+            return False;
+        }
+        budget = 1;
+    }
+    _kaf_sync(vcpu.data.lazy.flags);
+    vcpuins.data.flagIgnore = False;
+    vcpuins.data.flagMaskInt = False;
+    vcpuins.data.linear = linear;
+    vcpuins.data.jitBudget = budget ? budget : 1;
+    vcpuins.data.jitRun = 0;
+    (*(void (*)(void)) rentry->code)();
+    vcpuins.data.jitExec++;
+    vcpuins.data.jitIns += vcpuins.data.jitRun;
+    return True;
+}
+#endif
+
+/* if the debugger has to see cs:eip before it runs */
+static t_bool ExecBreak() {
+    return (vdebug.data.flagBreak && vcpu.data.cs.selector == vdebug.data.breakCS &&
+            vcpu.data.ip == vdebug.data.breakIP) ||
+           (vdebug.data.flagBreak32 && vcpu.data.cs.base + vcpu.data.eip == vdebug.data.breakLinear);
+}
+/* executes one instruction or a chain of translated blocks; returns instructions run */
+static t_nubit32 ExecBlock(t_nubit32 budget) {
+#if VCPUINS_JIT == 1
+    if (vcpuins.connect.flagJit && _kjt_exec(budget)) return vcpuins.data.jitRun;
+#endif
+    vcpuins.data.delayBudget = budget - 1;
+    vcpuins.data.delayRun = 0;
+    ExecIns();
+    return 1 + vcpuins.data.delayRun;
+}
+
 /* external interface */
 t_bool vcpuinsLoadSreg(t_cpu_data_sreg *rsreg, t_nubit16 selector) {
     t_bool fail;
     t_nubit32 oldexcept = vcpuins.data.except;
     vcpuins.data.except = 0;
+    _kfj_try
     _ksa_load_sreg(rsreg, selector);
+    _kfj_end
     fail = !!vcpuins.data.except;
     vcpuins.data.except = oldexcept;
     return fail;
@@ -13372,7 +14420,9 @@ t_bool vcpuinsReadLinear(t_nubit32 linear, t_vaddrcc rdata, t_nubit8 byte) {
     t_bool fail;
     t_nubit32 oldexcept = vcpuins.data.except;
     vcpuins.data.except = 0;
+    _kfj_try
     _kma_read_linear(linear, rdata, byte, 0x00, 1);
+    _kfj_end
     fail = !!vcpuins.data.except;
     vcpuins.data.except = oldexcept;
     return fail;
@@ -13381,13 +14431,359 @@ t_bool vcpuinsWriteLinear(t_nubit32 linear, t_vaddrcc rdata, t_nubit8 byte) {
     t_bool fail;
     t_nubit32 oldexcept = vcpuins.data.except;
     vcpuins.data.except = 0;
+    _kfj_try
     _kma_write_linear(linear, rdata, byte, 0x00, 1);
+    _kfj_end
     fail = !!vcpuins.data.except;
     vcpuins.data.except = oldexcept;
     return fail;
 }
+void vcpuinsFlushFetch() {
+    _kfc_flush();
+}
+void vcpuinsSyncFlags() {
+    _kaf_sync(vcpu.data.lazy.flags);
+}
 
+#if VCPUINS_MODRM_CHECK == 1
+/* register operand with number reg, eax to edi; none reads as zero */
+static t_vaddrcc ModrmCheckReg(t_nubit8 reg) {
+    switch (reg) {
+    case 0: return (t_vaddrcc)(&vcpu.data.eax);
+    case 1: return (t_vaddrcc)(&vcpu.data.ecx);
+    case 2: return (t_vaddrcc)(&vcpu.data.edx);
+    case 3: return (t_vaddrcc)(&vcpu.data.ebx);
+    case 4: return (t_vaddrcc)(&vcpu.data.esp);
+    case 5: return (t_vaddrcc)(&vcpu.data.ebp);
+    case 6: return (t_vaddrcc)(&vcpu.data.esi);
+    case 7: return (t_vaddrcc)(&vcpu.data.edi);
+    default: return (t_vaddrcc)(&vcpuins.connect.eaZero);
+    }
+}
+/* decodes a memory form the way the manual tables list it */
+static void ModrmCheckRef(t_cpuins_ea *rref, t_bool flag32, t_nubit8 modrm, t_nubit8 sib) {
+    t_nubit8 mod = _GetModRM_MOD(modrm), rm = _GetModRM_RM(modrm);
+    rref->base = rref->index = VCPUINS_EA_NONE;
+    rref->scale = 0;
+    if (!flag32) {
+        rref->disp = mod;
+        switch (rm) {
+        case 0: rref->base = 3; rref->index = 6; break; /* [bx+si] */
+        case 1: rref->base = 3; rref->index = 7; break; /* [bx+di] */
+        case 2: rref->base = 5; rref->index = 6; break; /* [bp+si] */
+        case 3: rref->base = 5; rref->index = 7; break; /* [bp+di] */
+        case 4: rref->index = 6; break; /* [si] */
+        case 5: rref->index = 7; break; /* [di] */
+        case 6: /* [bp], or [disp16] with mod 0 */
+            if (mod) rref->base = 5;
+            else rref->disp = 2;
+            break;
+        case 7: rref->base = 3; break; /* [bx] */
+        default: break;
+        }
+        rref->flagSS = rref->base == 5;
+        return;
+    }
+    rref->disp = (mod == 1) ? 1 : ((mod == 2) ? 4 : 0);
+    switch (rm) {
+    case 4: /* [sib] */
+        rref->base = (t_nubit8) _GetSIB_Base(sib);
+        if (_GetSIB_Index(sib) != 4) rref->index = (t_nubit8) _GetSIB_Index(sib);
+        rref->scale = (t_nubit8) _GetSIB_SS(sib);
+        if (!mod && rref->base == 5) {
+            rref->base = VCPUINS_EA_NONE;
+            rref->disp = 4;
+        }
+        break;
+    case 5: /* [ebp], or [disp32] with mod 0 */
+        if (mod) rref->base = 5;
+        else rref->disp = 4;
+        break;
+    default:
+        rref->base = rm;
+        break;
+    }
+    rref->flagSS = rref->base == 4 || rref->base == 5;
+}
+/* compares every table entry against the plain decoding */
+static void ModrmTableCheck() {
+    t_nubitcc i, k, flag32;
+    t_nubit8 disp;
+    t_cpuins_ea ref, *rea;
+    for (i = 0; i <= VCPUINS_EA_NONE; ++i) {
+        if (vcpuins.connect.eaReg[i] != ModrmCheckReg((t_nubit8) i))
+            PRINTF("ModRM check: eaReg[%d] mismatch\n", (int) i);
+    }
+    for (i = 0; i < 8; ++i) {
+        if (vcpuins.connect.regTable[0][i] != ModrmCheckReg((t_nubit8) (i & 3)) + (i >> 2))
+            PRINTF("ModRM check: byte register %d mismatch\n", (int) i);
+        if (vcpuins.connect.regTable[1][i] != ModrmCheckReg((t_nubit8) i))
+            PRINTF("ModRM check: word register %d mismatch\n", (int) i);
+        if (vcpuins.connect.regTable[2][i] != ModrmCheckReg((t_nubit8) i))
+            PRINTF("ModRM check: dword register %d mismatch\n", (int) i);
+    }
+    for (flag32 = 0; flag32 < 2; ++flag32) {
+        for (i = 0; i < 0xc0; ++i) {
+            for (k = 0; k < 0x100; ++k) {
+                /* resolves the form as _kdf_modrm does */
+                rea = &vcpuins.connect.eaTable[flag32][i];
+                disp = rea->disp;
+                if (rea->flagSIB) {
+                    rea = &vcpuins.connect.sibTable[_GetModRM_MOD(i) != 0][k];
+                    disp |= rea->disp;
+                } else if (k) break;
+                ModrmCheckRef(&ref, (t_bool) flag32, (t_nubit8) i, (t_nubit8) k);
+                if (rea->base != ref.base || rea->index != ref.index || rea->scale != ref.scale ||
+                        disp != ref.disp || rea->flagSS != ref.flagSS) {
+                    PRINTF("ModRM check: A%d ModRM=%02x SIB=%02x: base %d/%d, index %d/%d, "
+                           "scale %d/%d, disp %d/%d, ss %d/%d\n", flag32 ? 32 : 16, (int) i, (int) k,
+                           rea->base, ref.base, rea->index, ref.index, rea->scale, ref.scale,
+                           disp, ref.disp, rea->flagSS, ref.flagSS);
+                }
+            }
+        }
+    }
+}
+#endif
+/* effective address forms of modrm and sib bytes */
+static void ModrmTableInit() {
+    t_nubitcc i, mod, rm;
+    t_cpuins_ea *rea;
+    /* base and index of the 16-bit forms, by rm */
+    static const t_nubit8 base16[8] = {3, 3, 5, 5, VCPUINS_EA_NONE, VCPUINS_EA_NONE, 5, 3};
+    static const t_nubit8 index16[8] = {6, 7, 6, 7, 6, 7, VCPUINS_EA_NONE, VCPUINS_EA_NONE};
+    static const t_nubit8 disp16[3] = {0, 1, 2};
+    static const t_nubit8 disp32[3] = {0, 1, 4};
+    vcpuins.connect.eaReg[0] = (t_vaddrcc)(&vcpu.data.eax);
+    vcpuins.connect.eaReg[1] = (t_vaddrcc)(&vcpu.data.ecx);
+    vcpuins.connect.eaReg[2] = (t_vaddrcc)(&vcpu.data.edx);
+    vcpuins.connect.eaReg[3] = (t_vaddrcc)(&vcpu.data.ebx);
+    vcpuins.connect.eaReg[4] = (t_vaddrcc)(&vcpu.data.esp);
+    vcpuins.connect.eaReg[5] = (t_vaddrcc)(&vcpu.data.ebp);
+    vcpuins.connect.eaReg[6] = (t_vaddrcc)(&vcpu.data.esi);
+    vcpuins.connect.eaReg[7] = (t_vaddrcc)(&vcpu.data.edi);
+    vcpuins.connect.eaZero = 0;
+    vcpuins.connect.eaReg[VCPUINS_EA_NONE] = (t_vaddrcc)(&vcpuins.connect.eaZero);
+    vcpuins.connect.regTable[0][0] = (t_vaddrcc)(&vcpu.data.al);
+    vcpuins.connect.regTable[0][1] = (t_vaddrcc)(&vcpu.data.cl);
+    vcpuins.connect.regTable[0][2] = (t_vaddrcc)(&vcpu.data.dl);
+    vcpuins.connect.regTable[0][3] = (t_vaddrcc)(&vcpu.data.bl);
+    vcpuins.connect.regTable[0][4] = (t_vaddrcc)(&vcpu.data.ah);
+    vcpuins.connect.regTable[0][5] = (t_vaddrcc)(&vcpu.data.ch);
+    vcpuins.connect.regTable[0][6] = (t_vaddrcc)(&vcpu.data.dh);
+    vcpuins.connect.regTable[0][7] = (t_vaddrcc)(&vcpu.data.bh);
+    vcpuins.connect.regTable[1][0] = (t_vaddrcc)(&vcpu.data.ax);
+    vcpuins.connect.regTable[1][1] = (t_vaddrcc)(&vcpu.data.cx);
+    vcpuins.connect.regTable[1][2] = (t_vaddrcc)(&vcpu.data.dx);
+    vcpuins.connect.regTable[1][3] = (t_vaddrcc)(&vcpu.data.bx);
+    vcpuins.connect.regTable[1][4] = (t_vaddrcc)(&vcpu.data.sp);
+    vcpuins.connect.regTable[1][5] = (t_vaddrcc)(&vcpu.data.bp);
+    vcpuins.connect.regTable[1][6] = (t_vaddrcc)(&vcpu.data.si);
+    vcpuins.connect.regTable[1][7] = (t_vaddrcc)(&vcpu.data.di);
+    for (i = 0; i < 8; ++i) vcpuins.connect.regTable[2][i] = vcpuins.connect.eaReg[i];
+    for (i = 0; i < 0x100; ++i) {
+        mod = _GetModRM_MOD(i);
+        rm = _GetModRM_RM(i);
+        if (mod == 3) continue;
+        /* 16-bit: [bx/bp + si/di + disp], [disp16] with mod 0 and rm 6 */
+        rea = &vcpuins.connect.eaTable[0][i];
+        rea->base = base16[rm];
+        rea->index = index16[rm];
+        rea->disp = disp16[mod];
+        if (mod == 0 && rm == 6) {
+            rea->base = VCPUINS_EA_NONE;
+            rea->disp = 2;
+        }
+        rea->flagSS = rea->base == 5;
+        /* 32-bit: [reg + disp], [disp32] with mod 0 and rm 5, sib with rm 4 */
+        rea = &vcpuins.connect.eaTable[1][i];
+        rea->base = (t_nubit8) rm;
+        rea->index = VCPUINS_EA_NONE;
+        rea->disp = disp32[mod];
+        rea->flagSIB = rm == 4;
+        if (mod == 0 && rm == 5) {
+            rea->base = VCPUINS_EA_NONE;
+            rea->disp = 4;
+        }
+        rea->flagSS = rea->base == 5;
+    }
+    for (i = 0; i < 0x100; ++i) {
+        for (mod = 0; mod < 2; ++mod) {
+            /* [base + index * scale + disp], [index * scale + disp32] with mod 0 and base 5 */
+            rea = &vcpuins.connect.sibTable[mod][i];
+            rea->base = (t_nubit8) _GetSIB_Base(i);
+            rea->index = (t_nubit8) _GetSIB_Index(i);
+            rea->scale = (t_nubit8) _GetSIB_SS(i);
+            if (rea->index == 4) rea->index = VCPUINS_EA_NONE;
+            if (!mod && rea->base == 5) {
+                rea->base = VCPUINS_EA_NONE;
+                rea->disp = 4;
+            }
+            rea->flagSS = rea->base == 4 || rea->base == 5;
+        }
+    }
+#if VCPUINS_MODRM_CHECK == 1
+    ModrmTableCheck();
+#endif
+}
+static void LazyTableInit() {
+    t_nubitcc i;
+    for (i = 0; i < 0x100; ++i) {
+        vcpuins.connect.lazyTable[i] = False;
+        vcpuins.connect.lazyTable_0f[i] = False;
+    }
+    /* add, or, adc, sbb, and, sub, xor, cmp */
+    for (i = 0x00; i < 0x40; i += 0x08) {
+        vcpuins.connect.lazyTable[i + 0] = True;
+        vcpuins.connect.lazyTable[i + 1] = True;
+        vcpuins.connect.lazyTable[i + 2] = True;
+        vcpuins.connect.lazyTable[i + 3] = True;
+        vcpuins.connect.lazyTable[i + 4] = True;
+        vcpuins.connect.lazyTable[i + 5] = True;
+    }
+    /* prefixes */
+    vcpuins.connect.lazyTable[0x0f] = True;
+    vcpuins.connect.lazyTable[0x26] = True;
+    vcpuins.connect.lazyTable[0x2e] = True;
+    vcpuins.connect.lazyTable[0x36] = True;
+    vcpuins.connect.lazyTable[0x3e] = True;
+    vcpuins.connect.lazyTable[0x64] = True;
+    vcpuins.connect.lazyTable[0x65] = True;
+    vcpuins.connect.lazyTable[0x66] = True;
+    vcpuins.connect.lazyTable[0x67] = True;
+    vcpuins.connect.lazyTable[0xf0] = True;
+    vcpuins.connect.lazyTable[0xf2] = True;
+    vcpuins.connect.lazyTable[0xf3] = True;
+    /* inc, dec, push, pop, jcc */
+    for (i = 0x40; i < 0x60; ++i) vcpuins.connect.lazyTable[i] = True;
+    for (i = 0x70; i < 0x80; ++i) vcpuins.connect.lazyTable[i] = True;
+    /* arithmetic with immediate, test, xchg, mov, lea */
+    for (i = 0x80; i < 0x8f; ++i) vcpuins.connect.lazyTable[i] = True;
+    /* nop, xchg, cbw, cwd */
+    for (i = 0x90; i < 0x9a; ++i) vcpuins.connect.lazyTable[i] = True;
+    /* mov, movs, stos, lods, test */
+    for (i = 0xa0; i < 0xa6; ++i) vcpuins.connect.lazyTable[i] = True;
+    for (i = 0xa8; i < 0xae; ++i) vcpuins.connect.lazyTable[i] = True;
+    for (i = 0xb0; i < 0xc0; ++i) vcpuins.connect.lazyTable[i] = True;
+    /* ret near, mov */
+    vcpuins.connect.lazyTable[0xc2] = True;
+    vcpuins.connect.lazyTable[0xc3] = True;
+    vcpuins.connect.lazyTable[0xc6] = True;
+    vcpuins.connect.lazyTable[0xc7] = True;
+    /* loopcc, jcxz, call near, jmp near, inc/dec rm8 */
+    for (i = 0xe0; i < 0xe4; ++i) vcpuins.connect.lazyTable[i] = True;
+    vcpuins.connect.lazyTable[0xe8] = True;
+    vcpuins.connect.lazyTable[0xe9] = True;
+    vcpuins.connect.lazyTable[0xeb] = True;
+    vcpuins.connect.lazyTable[0xfe] = True;
+    /* jcc, setcc, movzx, movsx */
+    for (i = 0x80; i < 0xa0; ++i) vcpuins.connect.lazyTable_0f[i] = True;
+    vcpuins.connect.lazyTable_0f[0xb6] = True;
+    vcpuins.connect.lazyTable_0f[0xb7] = True;
+    vcpuins.connect.lazyTable_0f[0xbe] = True;
+    vcpuins.connect.lazyTable_0f[0xbf] = True;
+}
+/* compare, test, sub, and, inc and dec, in all of their forms */
+static void FuseTableInit() {
+    t_nubitcc i;
+    for (i = 0; i < 0x100; ++i) vcpuins.connect.fuseTable[i] = 0x00;
+    for (i = 0; i < 6; ++i) {
+        vcpuins.connect.fuseTable[0x20 + i] = 0xff;
+        vcpuins.connect.fuseTable[0x28 + i] = 0xff;
+        vcpuins.connect.fuseTable[0x38 + i] = 0xff;
+    }
+    for (i = 0x40; i < 0x50; ++i) vcpuins.connect.fuseTable[i] = 0xff;
+    /* and, sub and cmp with immediate */
+    vcpuins.connect.fuseTable[0x80] = 0xb0;
+    vcpuins.connect.fuseTable[0x81] = 0xb0;
+    vcpuins.connect.fuseTable[0x83] = 0xb0;
+    vcpuins.connect.fuseTable[0x84] = 0xff;
+    vcpuins.connect.fuseTable[0x85] = 0xff;
+    vcpuins.connect.fuseTable[0xa8] = 0xff;
+    vcpuins.connect.fuseTable[0xa9] = 0xff;
+    /* test with immediate */
+    vcpuins.connect.fuseTable[0xf6] = 0x01;
+    vcpuins.connect.fuseTable[0xf7] = 0x01;
+    /* inc and dec */
+    vcpuins.connect.fuseTable[0xfe] = 0x03;
+}
+#define _kdf_spec_set(table, opcode, name, flag32) \
+    ((table)[(opcode)] = (t_faddrcc) ((flag32) ? name##_O32 : name##_O16))
+static void SpecTableInit() {
+    t_nubitcc i, k;
+    t_bool flag32;
+    t_faddrcc *table;
+    for (k = 0; k < VCPUINS_SPEC_COUNT; ++k) {
+        table = vcpuins.connect.insTableSpec[k];
+        for (i = 0; i < 0x100; ++i) table[i] = vcpuins.connect.insTable[i];
+        flag32 = !!(k & VCPUINS_SPEC_OPR32);
+        _kdf_spec_set(table, 0x01, ADD_RM32_R32, flag32);
+        _kdf_spec_set(table, 0x03, ADD_R32_RM32, flag32);
+        _kdf_spec_set(table, 0x09, OR_RM32_R32, flag32);
+        _kdf_spec_set(table, 0x0b, OR_R32_RM32, flag32);
+        _kdf_spec_set(table, 0x11, ADC_RM32_R32, flag32);
+        _kdf_spec_set(table, 0x13, ADC_R32_RM32, flag32);
+        _kdf_spec_set(table, 0x19, SBB_RM32_R32, flag32);
+        _kdf_spec_set(table, 0x1b, SBB_R32_RM32, flag32);
+        _kdf_spec_set(table, 0x21, AND_RM32_R32, flag32);
+        _kdf_spec_set(table, 0x23, AND_R32_RM32, flag32);
+        _kdf_spec_set(table, 0x29, SUB_RM32_R32, flag32);
+        _kdf_spec_set(table, 0x2b, SUB_R32_RM32, flag32);
+        _kdf_spec_set(table, 0x31, XOR_RM32_R32, flag32);
+        _kdf_spec_set(table, 0x33, XOR_R32_RM32, flag32);
+        _kdf_spec_set(table, 0x39, CMP_RM32_R32, flag32);
+        _kdf_spec_set(table, 0x3b, CMP_R32_RM32, flag32);
+        _kdf_spec_set(table, 0x40, INC_EAX, flag32);
+        _kdf_spec_set(table, 0x41, INC_ECX, flag32);
+        _kdf_spec_set(table, 0x42, INC_EDX, flag32);
+        _kdf_spec_set(table, 0x43, INC_EBX, flag32);
+        _kdf_spec_set(table, 0x44, INC_ESP, flag32);
+        _kdf_spec_set(table, 0x45, INC_EBP, flag32);
+        _kdf_spec_set(table, 0x46, INC_ESI, flag32);
+        _kdf_spec_set(table, 0x47, INC_EDI, flag32);
+        _kdf_spec_set(table, 0x48, DEC_EAX, flag32);
+        _kdf_spec_set(table, 0x49, DEC_ECX, flag32);
+        _kdf_spec_set(table, 0x4a, DEC_EDX, flag32);
+        _kdf_spec_set(table, 0x4b, DEC_EBX, flag32);
+        _kdf_spec_set(table, 0x4c, DEC_ESP, flag32);
+        _kdf_spec_set(table, 0x4d, DEC_EBP, flag32);
+        _kdf_spec_set(table, 0x4e, DEC_ESI, flag32);
+        _kdf_spec_set(table, 0x4f, DEC_EDI, flag32);
+        _kdf_spec_set(table, 0x50, PUSH_EAX, flag32);
+        _kdf_spec_set(table, 0x51, PUSH_ECX, flag32);
+        _kdf_spec_set(table, 0x52, PUSH_EDX, flag32);
+        _kdf_spec_set(table, 0x53, PUSH_EBX, flag32);
+        _kdf_spec_set(table, 0x54, PUSH_ESP, flag32);
+        _kdf_spec_set(table, 0x55, PUSH_EBP, flag32);
+        _kdf_spec_set(table, 0x56, PUSH_ESI, flag32);
+        _kdf_spec_set(table, 0x57, PUSH_EDI, flag32);
+        _kdf_spec_set(table, 0x58, POP_EAX, flag32);
+        _kdf_spec_set(table, 0x59, POP_ECX, flag32);
+        _kdf_spec_set(table, 0x5a, POP_EDX, flag32);
+        _kdf_spec_set(table, 0x5b, POP_EBX, flag32);
+        _kdf_spec_set(table, 0x5c, POP_ESP, flag32);
+        _kdf_spec_set(table, 0x5d, POP_EBP, flag32);
+        _kdf_spec_set(table, 0x5e, POP_ESI, flag32);
+        _kdf_spec_set(table, 0x5f, POP_EDI, flag32);
+        _kdf_spec_set(table, 0xb8, MOV_EAX_I32, flag32);
+        _kdf_spec_set(table, 0xb9, MOV_ECX_I32, flag32);
+        _kdf_spec_set(table, 0xba, MOV_EDX_I32, flag32);
+        _kdf_spec_set(table, 0xbb, MOV_EBX_I32, flag32);
+        _kdf_spec_set(table, 0xbc, MOV_ESP_I32, flag32);
+        _kdf_spec_set(table, 0xbd, MOV_EBP_I32, flag32);
+        _kdf_spec_set(table, 0xbe, MOV_ESI_I32, flag32);
+        _kdf_spec_set(table, 0xbf, MOV_EDI_I32, flag32);
+        if (!(k & VCPUINS_SPEC_PROT)) {
+            table[0x07] = (t_faddrcc) POP_ES_REAL;
+            table[0x1f] = (t_faddrcc) POP_DS_REAL;
+            table[0x8e] = (t_faddrcc) MOV_SREG_RM16_REAL;
+        }
+    }
+}
 void vcpuinsInit() {
+#if VCPUINS_JIT == 1
+    t_nsbit64 jitReach;
+#endif
     vcpuins.connect.insTable[0x00] = (t_faddrcc) ADD_RM8_R8;
     vcpuins.connect.insTable[0x01] = (t_faddrcc) ADD_RM32_R32;
     vcpuins.connect.insTable[0x02] = (t_faddrcc) ADD_R8_RM8;
@@ -13902,16 +15298,60 @@ void vcpuinsInit() {
     vcpuins.connect.insTable_0f[0xfd] = (t_faddrcc) UndefinedOpcode;
     vcpuins.connect.insTable_0f[0xfe] = (t_faddrcc) UndefinedOpcode;
     vcpuins.connect.insTable_0f[0xff] = (t_faddrcc) UndefinedOpcode;
+    ModrmTableInit();
+    LazyTableInit();
+    FuseTableInit();
+#if VCPUINS_JIT == 1
+    /* generated code addresses vcpuins fields as rbx+disp32 with rbx = &vcpu,
+     * so both must lie within 2 GB of each other; it is written and run from
+     * a single read-write-execute mapping */
+    jitReach = (t_nsbit64) (GetRef(vcpuins) - GetRef(vcpu));
+    if (jitReach >= -(t_nsbit64) 0x80000000 &&
+            jitReach + (t_nsbit64) sizeof(t_cpuins) <= (t_nsbit64) 0x7fffffff) {
+        vcpuins.connect.jitCode = (t_vaddrcc) utilsAllocExec(VCPUINS_JIT_CODE);
+    }
+#endif
 }
 void vcpuinsReset() {
+    /* built here to pick up opcodes taken over after init, e.g. qdx */
+    SpecTableInit();
     MEMSET((void *)(&vcpuins.data), Zero8, sizeof(t_cpuins_data));
+    vcpuins.data.jitVersion = vram.connect.pVersion;
 }
+/* runs instructions until the budget is used, or an i/o access, interrupt,
+   halt, stop or break point hands control back to the devices */
 void vcpuinsRefresh() {
-    if (!vcpu.data.flagHalt) {
-        ExecIns();
-    } else {
-        utilsSleep(1);
+    t_nubit32 count = 0, budget = VCPUINS_RUN_BUDGET;
+    t_nubit64 deadline;
+    if (vcpu.data.flagHalt) {
+        /* nothing to run before an interrupt: let time pass to the next event */
+        ExecInt();
+        if (vcpu.data.flagHalt) {
+            vmachineIdle();
+        }
+        return;
     }
-    ExecInt();
+    /* run until the next device deadline */
+    deadline = vmachineGetDeadline();
+    if (deadline <= vmachine.data.clock) {
+        budget = 1;
+    } else if (deadline - vmachine.data.clock < budget) {
+        budget = GetMax32(deadline - vmachine.data.clock);
+    }
+    if (vdebug.data.flagTrace || vdebug.connect.recordFile) budget = 1;
+    do {
+        count += ExecBlock(budget - count);
+        ExecInt();
+    } while (count < budget && device.flagRun && !vcpu.data.flagHalt &&
+             !vcpuins.data.flagIgnore && !ExecBreak());
+    vmachine.data.clock += count;
+    vdebug.data.breakCount += count - 1;
+}
+void vcpuinsFinal() {
+#if VCPUINS_JIT == 1
+    if (vcpuins.connect.jitCode) {
+        utilsFreeExec((void *) vcpuins.connect.jitCode, VCPUINS_JIT_CODE);
+        vcpuins.connect.jitCode = 0;
+    }
+#endif
 }
-void vcpuinsFinal() {}
@@ -51,6 +51,113 @@ typedef struct {
     t_nubit64 data;
 } t_cpuins_data_memory;
 
+#define VCPUINS_FCACHE_SIZE 0x1000 /* number of fetch cache entries */
+#define VCPUINS_REP_CHUNK   0x1000 /* max string elements per repeated instruction run */
+
+/* dispatch tables specialized by cpu mode and operand size; the handlers
+   that are specialized do not depend on address size */
+#define VCPUINS_SPEC_REAL   0x00 /* real or virtual-8086 mode */
+#define VCPUINS_SPEC_PROT   0x02 /* protected mode */
+#define VCPUINS_SPEC_OPR32  0x01 /* 32-bit operand size */
+#define VCPUINS_SPEC_COUNT  0x04
+
+#define VCPUINS_RUN_BUDGET 0x100 /* instructions per refresh unless an exit is forced */
+
+#define VCPUINS_JIT_SIZE  0x1000   /* number of jit block entries */
+#define VCPUINS_JIT_HOT   0x20     /* executions before a block is translated */
+#define VCPUINS_JIT_INS   0x40     /* max guest instructions per block */
+#define VCPUINS_JIT_BLOCK 0x1200   /* max host code bytes per block */
+#define VCPUINS_JIT_CODE  0x400000 /* host code buffer size */
+
+typedef struct {
+    t_bool    flagValid; /* entry tracks the block at linear */
+    t_bool    flagA20;
+    t_bool    defsize;
+    t_nubit32 linear, eip, cslimit;
+    t_nubit32 version; /* page version when the entry is filled */
+    t_nubit32 count; /* executions counted before translation */
+    t_nubit32 nins, length; /* guest instructions and bytes in the block */
+    t_vaddrcc code; /* translated host code, or 0 */
+    t_vaddrcc guest; /* copy of guest code the block is translated from */
+} t_cpuins_data_jit;
+
+/* guest instruction decoded for translation */
+typedef struct {
+    t_nubit8 kind, op, bit;
+    t_nubit8 dest, src; /* guest register numbers */
+    t_bool flagImm;
+    t_nubit32 imm;
+    t_nubit32 read, write; /* status flags used and defined */
+    t_nubit32 capture; /* defined status flags that are live afterwards */
+    t_nubit32 next, target; /* eip of next instruction and branch target */
+} t_cpuins_jit_ins;
+
+typedef struct {
+    t_bool    flagValid;
+    t_bool    flagA20;
+    t_bool    defsize;
+    t_nubit8  oplen;
+    t_nubit32 linear;
+    t_nubit32 phy1, phy2; /* physical address of the first byte in each page */
+    t_nubit32 ver1, ver2; /* page versions when the entry is filled */
+    t_nubit8  opcodes[15];
+} t_cpuins_data_fetch;
+
+#define VCPUINS_TLB_SIZE 0x100 /* number of tlb entries */
+
+typedef struct {
+    t_bool    flagValid;
+    t_bool    flagA20;
+    t_bool    flagUser;  /* if page is accessible at cpl 3 */
+    t_bool    flagWrite; /* if page is writable at cpl 3 */
+    t_bool    flagDirty; /* if dirty bit is already set */
+    t_nubit32 linear;    /* linear address of page */
+    t_nubit32 physical;  /* physical address of page frame */
+    t_nubit32 ppde, ppte; /* physical address of page table entries */
+    t_nubit32 verpde, verpte; /* page versions of page table entries */
+} t_cpuins_data_tlb;
+
+#define VCPUINS_EA_NONE 0x08 /* no base or index register */
+
+/* effective address form of a modrm byte, or of a sib byte */
+typedef struct {
+    t_nubit8 base, index; /* register numbers, eax to edi */
+    t_nubit8 scale; /* index shift count */
+    t_nubit8 disp; /* displacement bytes */
+    t_bool   flagSS; /* if default segment is ss */
+    t_bool   flagSIB; /* if sib byte follows */
+} t_cpuins_ea;
+
+#define VCPUINS_XCACHE_SIZE 0x100 /* number of raw descriptor cache entries */
+
+typedef struct {
+    t_bool    flagValid;
+    t_bool    flagA20;
+    t_nubit16 selector; /* table indicator and index */
+    t_nubit32 tbase, tlimit; /* descriptor table the entry is read from */
+    t_nubit32 phy1, phy2; /* physical address of the first byte in each page */
+    t_nubit32 ver1, ver2; /* page versions when the entry is filled */
+    t_nubit64 descriptor;
+} t_cpuins_data_desc;
+
+#define VCPUINS_UNDO_SREG 10 /* number of segment registers in vcpu */
+#define VCPUINS_UNDO_REG  8  /* max number of logged control registers */
+
+typedef struct {
+    /* register file, saved before each instruction */
+    t_nubit32 eax, ecx, edx, ebx, esp, ebp, esi, edi, eip, eflags;
+    t_bool flagMaskNMI, flagNMI, flagHalt;
+    t_cpu_data_lazy lazy;
+    /* segment registers, saved before the first write */
+    t_cpu_data_sreg *rsreg[VCPUINS_UNDO_SREG];
+    t_cpu_data_sreg sreg[VCPUINS_UNDO_SREG];
+    t_nubit8 nsreg;
+    /* control, debug and test registers, saved before the first write */
+    t_nubit32 *rreg[VCPUINS_UNDO_REG];
+    t_nubit32 reg[VCPUINS_UNDO_REG];
+    t_nubit8 nreg;
+} t_cpuins_data_undo;
+
 typedef struct {
     /* prefixes */
     t_cpuins_data_prefix_rep  prefix_rep;
@@ -58,8 +165,10 @@ typedef struct {
     t_cpuins_data_prefix      prefix_addrsize;
     t_cpu_data_sreg *roverds, *roverss, *rmovsreg;
 
+    t_faddrcc *rinsTable; /* dispatch table of current mode and sizes */
+
     /* execution control */
-    t_cpu  oldcpu;
+    t_cpuins_data_undo undo;
     t_bool flagInsLoop;
     t_bool flagMaskInt; /* if int is disabled once */
 
@@ -75,9 +184,12 @@ typedef struct {
     t_nubit32 bit;
     t_cpuins_data_arithtype type;
     t_nubit32 udf; /* undefined eflags bits */
+    t_bool flagLazy; /* if status flags can be evaluated lazily */
+    t_bool flagFuse; /* if a following jcc may run along with the instruction */
 
     /* exception handler */
     t_nubit32 except, excode;
+    jmp_buf *rfault; /* innermost fault frame */
 
     /* debugger */
     t_nubit32 linear;
@@ -92,12 +204,59 @@ typedef struct {
     t_nubit8 opcodes[15];
     t_nubit16 reccs;
     t_nubit32 receip;
+
+    /* fetch cache */
+    t_cpuins_data_fetch fcache[VCPUINS_FCACHE_SIZE];
+    t_nubit64 fcacheHit, fcacheMiss, fcacheFlush;
+
+    /* translation lookaside buffer */
+    t_cpuins_data_tlb tlb[VCPUINS_TLB_SIZE];
+    t_nubit64 tlbHit, tlbMiss, tlbFlush;
+
+    /* descriptor cache */
+    t_cpuins_data_desc xcache[VCPUINS_XCACHE_SIZE];
+    t_nubit64 xcacheHit, xcacheMiss;
+
+    /* translated blocks */
+    t_cpuins_data_jit jit[VCPUINS_JIT_SIZE];
+    t_nubit32 jitUsed; /* bytes used in host code buffer */
+    t_nubit32 jitBudget; /* instructions the current chain may still run */
+    t_nubit32 jitRun; /* instructions run by the current chain */
+    t_vaddrcc jitLink, jitLinkEntry; /* unlinked exit stub the chain left by */
+    t_nubit32 *jitVersion; /* page version array the links refer to */
+    t_nubit64 jitBlock, jitExec, jitIns, jitFlush, jitChain;
+
+    /* delay loops */
+    t_nubit32 delayBudget; /* instructions the current one may retire besides itself */
+    t_nubit32 delayRun; /* instructions retired besides the current one */
+    t_nubit64 delayLoop, delayIns;
+
+    /* compare and branch fusion */
+    t_nubit64 fuseIns; /* jcc run along with the instruction before */
 } t_cpuins_data;
 
 typedef struct {
     /* instruction dispatch */
     t_faddrcc insTable[0x100];
     t_faddrcc insTable_0f[0x100];
+    t_faddrcc insTableSpec[VCPUINS_SPEC_COUNT][0x100];
+    /* effective address forms by address size: 16-bit (0) or 32-bit (1) */
+    t_cpuins_ea eaTable[2][0x100];
+    /* sib forms with mod 0 (0) or with displacement (1) */
+    t_cpuins_ea sibTable[2][0x100];
+    /* addresses of base and index registers, and of r/m registers by size */
+    t_vaddrcc eaReg[VCPUINS_EA_NONE + 1];
+    t_vaddrcc regTable[3][8];
+    t_nubit32 eaZero;
+    /* instructions that never touch eflags other than by arithmetic */
+    t_bool lazyTable[0x100];
+    t_bool lazyTable_0f[0x100];
+    /* instructions that are usually followed by jcc, as a mask of the
+       modrm reg fields that select them in group opcodes */
+    t_nubit8 fuseTable[0x100];
+    /* host code buffer of translated blocks */
+    t_bool flagJit;
+    t_vaddrcc jitCode;
 } t_cpuins_connect;
 
 typedef struct {
@@ -130,6 +289,8 @@ extern t_cpuins vcpuins;
 t_bool vcpuinsLoadSreg(t_cpu_data_sreg *rsreg, t_nubit16 selector);
 t_bool vcpuinsReadLinear(t_nubit32 linear, t_vaddrcc rdata, t_nubit8 byte);
 t_bool vcpuinsWriteLinear(t_nubit32 linear, t_vaddrcc rdata, t_nubit8 byte);
+void vcpuinsFlushFetch();
+void vcpuinsSyncFlags();
 
 void vcpuinsInit();
 void vcpuinsReset();
@@ -139,6 +139,7 @@ void vdebugRefresh() {
     if (vdebug.connect.recordFile) {
         t_nubitcc i;
         t_string stmt;
+        vcpuinsSyncFlags();
         FPRINTF(vdebug.connect.recordFile, _expression,
                 vcpu.data.cs.selector, vcpu.data.eip, vcpu.data.cs.base + vcpu.data.eip,
                 vcpu.data.ss.selector, vcpu.data.esp, vcpu.data.ss.base + vcpu.data.esp,
@@ -5,6 +5,7 @@
 #include "../utils.h"
 
 #include "vram.h"
+#include "vmachine.h"
 
 #include "vbios.h"
 #include "vport.h"
@@ -13,6 +14,13 @@
 t_latch vlatch;
 t_dma vdma1, vdma2;
 
+static t_nubit8 eventService;
+
+/* Services requests when cpu leaves its run loop */
+static void Schedule() {
+    vmachineSetEvent(eventService, vmachine.data.clock);
+}
+
 static void doReset(t_dma *rdma) {
     MEMSET((void *)(&rdma->data), Zero8, sizeof(t_dma_data));
     rdma->data.mask = VDMA_MASK_VALID;
@@ -59,21 +67,24 @@ static void io_write_WordCount(t_dma *rdma, t_nubit8 id) {
     rdma->data.currCount[id] = rdma->data.baseCount[id];
     rdma->data.flagMSB = !rdma->data.flagMSB;
 }
-#define     io_write_Command(rdma) ((rdma)->data.command = vport.data.ioByte)
+#define     io_write_Command(rdma) ((rdma)->data.command = vport.data.ioByte, Schedule())
 static void io_write_Request_Single(t_dma *rdma) {
     MakeBit(rdma->data.request, VDMA_REQUEST_DRQ(VDMA_GetREQSC_CS(vport.data.ioByte)),
             GetBit(vport.data.ioByte, VDMA_REQSC_SR));
+    Schedule();
 }
 static void io_write_Mask_Single(t_dma *rdma) {
     MakeBit(rdma->data.mask, VDMA_MASK_DRQ(VDMA_GetMASKSC_CS(vport.data.ioByte)),
             GetBit(vport.data.ioByte, VDMA_MASKSC_SM));
+    Schedule();
 }
 #define     io_write_Mode(rdma) \
             ((rdma)->data.mode[VDMA_GetMODE_CS(vport.data.ioByte)] = vport.data.ioByte)
 #define     io_write_Flipflop_Clear(rdma) ((rdma)->data.flagMSB = False)
 #define     io_write_Reset(rdma) (doReset(rdma))
-#define     io_write_Mask_Clear(rdma) ((rdma)->data.mask = Zero8)
-#define     io_write_Mask_All(rdma) ((rdma)->data.mask = vport.data.ioByte & VDMA_MASKAC_VALID)
+#define     io_write_Mask_Clear(rdma) ((rdma)->data.mask = Zero8, Schedule())
+#define     io_write_Mask_All(rdma) \
+            ((rdma)->data.mask = vport.data.ioByte & VDMA_MASKAC_VALID, Schedule())
 #define     io_write_Page(rdma, id, m) \
             ((rdma)->data.page[(id)] = vport.data.ioByte & (m))
 
@@ -442,6 +453,32 @@ static void Execute(t_dma *rdma, t_nubit8 id, t_bool flagWord) {
     }
     rdma->data.flagEOP = False;
 }
+/* Tests if vdmaRefresh has a request to work on */
+static t_bool Pending() {
+    t_nubit8 realDRQ1, realDRQ2;
+    if (GetBit(vdma2.data.command, VDMA_COMMAND_CTRL)) {
+        return False;
+    }
+    if (GetBit(vdma2.data.isr, VDMA_ISR_IS)) {
+        return True;
+    }
+    realDRQ2 = vdma2.data.request | (VDMA_GetSTATUS_DRQS(vdma2.data.status) & ~vdma2.data.mask);
+    if (GetRegTopId(&vdma2, realDRQ2) != 0) {
+        return (realDRQ2 != Zero8);
+    }
+    if (GetBit(vdma1.data.command, VDMA_COMMAND_CTRL)) {
+        return False;
+    }
+    realDRQ1 = vdma1.data.request | (VDMA_GetSTATUS_DRQS(vdma1.data.status) & ~vdma1.data.mask);
+    return (realDRQ1 != Zero8);
+}
+/* Services one request, and keeps servicing until no request is left */
+static void Service() {
+    vdmaRefresh();
+    if (Pending()) {
+        vmachineSetEvent(eventService, vmachine.data.clock + 1);
+    }
+}
 
 void vdmaSetDRQ(t_nubit8 drqId) {
     switch (drqId) {
@@ -465,6 +502,7 @@ void vdmaSetDRQ(t_nubit8 drqId) {
     } else {
         ClrBit(vdma2.data.status, VDMA_STATUS_DRQ(0));
     }
+    Schedule();
 }
 void vdmaAddDevice(t_nubit8 drqId, t_faddrcc fpReadDevice,
                    t_faddrcc fpWriteDevice, t_faddrcc fpCloseDevice) {
@@ -494,6 +532,7 @@ void vdmaInit() {
     MEMSET((void *)(&vlatch), Zero8, sizeof(t_latch));
     MEMSET((void *)(&vdma1), Zero8, sizeof(t_dma));
     MEMSET((void *)(&vdma2), Zero8, sizeof(t_dma));
+    eventService = vmachineAddEvent((t_faddrcc) Service);
 
     vportAddRead(0x0000, (t_faddrcc) io_read_0000);
     vportAddRead(0x0001, (t_faddrcc) io_read_0001);
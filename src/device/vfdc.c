@@ -372,6 +372,7 @@ static void io_read_03F5() {
 }
 /* read digital input register */
 static void io_read_03F7() {
+    vfdcRefresh();
     vport.data.ioByte = vfdc.data.dir;
 }
 
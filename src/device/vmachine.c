@@ -40,8 +40,239 @@
 #define _vvadp_
 #define _qdx_
 
+t_machine vmachine;
+
+#define EventTime(pos) (vmachine.data.event[vmachine.data.heap[(pos)]].time)
+
+/* Places heap entry and records its position */
+static void HeapPut(t_nubit8 pos, t_nubit8 id) {
+    vmachine.data.heap[pos] = id;
+    vmachine.data.event[id].pos = pos;
+}
+/* Moves heap entry towards root while it is earlier than its parent */
+static void HeapUp(t_nubit8 pos) {
+    t_nubit8 id = vmachine.data.heap[pos];
+    while (pos && vmachine.data.event[id].time < EventTime((pos - 1) >> 1)) {
+        HeapPut(pos, vmachine.data.heap[(pos - 1) >> 1]);
+        pos = (pos - 1) >> 1;
+    }
+    HeapPut(pos, id);
+}
+/* Moves heap entry towards leaves while it is later than its children */
+static void HeapDown(t_nubit8 pos) {
+    t_nubit8 child, id = vmachine.data.heap[pos];
+    while ((child = (pos << 1) + 1) < vmachine.data.heapCount) {
+        if (child + 1 < vmachine.data.heapCount && EventTime(child + 1) < EventTime(child)) {
+            child++;
+        }
+        if (EventTime(child) >= vmachine.data.event[id].time) {
+            break;
+        }
+        HeapPut(pos, vmachine.data.heap[child]);
+        pos = child;
+    }
+    HeapPut(pos, id);
+}
+/* Removes heap entry */
+static void HeapRemove(t_nubit8 pos) {
+    t_nubit8 id = vmachine.data.heap[pos];
+    vmachine.data.event[id].pos = VMACHINE_MAX_EVENT;
+    if (pos == --vmachine.data.heapCount) {
+        return;
+    }
+    id = vmachine.data.heap[vmachine.data.heapCount];
+    HeapPut(pos, id);
+    HeapUp(pos);
+    HeapDown(vmachine.data.event[id].pos);
+}
+/* Executes all events whose deadlines are due */
+static void ExecEvents() {
+    t_nubit8 id;
+    while (vmachine.data.heapCount && EventTime(0) <= vmachine.data.clock) {
+        id = vmachine.data.heap[0];
+        HeapRemove(0);
+        ExecFun(vmachine.data.event[id].fpEvent);
+    }
+}
+
+/* Registers device action to be scheduled on virtual time, returns event id */
+t_nubit8 vmachineAddEvent(t_faddrcc fpEvent) {
+    t_nubit8 id = vmachine.data.eventCount++;
+    vmachine.data.event[id].fpEvent = fpEvent;
+    vmachine.data.event[id].pos = VMACHINE_MAX_EVENT;
+    return id;
+}
+/* Arms or moves event deadline; to run on next pass, use clock + 1 */
+void vmachineSetEvent(t_nubit8 id, t_nubit64 time) {
+    if (vmachine.data.event[id].pos == VMACHINE_MAX_EVENT) {
+        vmachine.data.event[id].time = time;
+        HeapPut(vmachine.data.heapCount, id);
+        HeapUp(vmachine.data.heapCount++);
+    } else {
+        vmachine.data.event[id].time = time;
+        HeapUp(vmachine.data.event[id].pos);
+        HeapDown(vmachine.data.event[id].pos);
+    }
+}
+/* Disarms event */
+void vmachineClearEvent(t_nubit8 id) {
+    if (vmachine.data.event[id].pos != VMACHINE_MAX_EVENT) {
+        HeapRemove(vmachine.data.event[id].pos);
+    }
+}
+/* Returns virtual time of the earliest deadline */
+t_nubit64 vmachineGetDeadline() {
+    return vmachine.data.heapCount ? EventTime(0) : Max64;
+}
+
+#define NS_PER_SEC 1000000000
+
+/* Computes a * mul / div, rounded down or up, without overflow for 32-bit mul and div */
+static t_nubit64 MulDiv(t_nubit64 a, t_nubit64 mul, t_nubit64 div) {
+    return (a / div) * mul + (a % div) * mul / div;
+}
+static t_nubit64 MulDivUp(t_nubit64 a, t_nubit64 mul, t_nubit64 div) {
+    return (a / div) * mul + ((a % div) * mul + div - 1) / div;
+}
+/* Converts between virtual clock and virtual time in nanoseconds */
+static t_nubit64 GetTimeAt(t_nubit64 clock) {
+    return vmachine.data.timeBase +
+           MulDiv(clock - vmachine.data.clockBase, NS_PER_SEC, vmachine.connect.ips);
+}
+static t_nubit64 GetClockAt(t_nubit64 time) {
+    if (time <= vmachine.data.timeBase) {
+        return vmachine.data.clockBase;
+    }
+    return vmachine.data.clockBase +
+           MulDivUp(time - vmachine.data.timeBase, vmachine.connect.ips, NS_PER_SEC);
+}
+/* Starts pacing from now unless it is running and consistent */
+static t_bool PaceStart() {
+    t_nubit64 guest = vmachineGetTime();
+    if (!vmachine.data.paceHost || guest < vmachine.data.paceTime) {
+        vmachine.data.paceHost = utilsGetTime();
+        vmachine.data.paceTime = guest;
+        return True;
+    }
+    return False;
+}
+/* Sleeps while virtual time is ahead of host time */
+static void Pace() {
+    t_nubit64 host, guest;
+    if (PaceStart()) {
+        return;
+    }
+    host = utilsGetTime() - vmachine.data.paceHost;
+    guest = (vmachineGetTime() - vmachine.data.paceTime) / 1000;
+    if (guest > host + 1000) {
+        utilsSleep(GetMax32((guest - host) / 1000));
+    } else if (host > guest + 100000) {
+        /* too far behind to catch up: restart pacing from now */
+        vmachine.data.paceHost = 0;
+    }
+}
+
+/* Returns virtual time in nanoseconds */
+t_nubit64 vmachineGetTime() {
+    return GetTimeAt(vmachine.data.clock);
+}
+/* Returns count of ticks of a freq Hz device clock elapsed in virtual time */
+t_nubit64 vmachineGetTicks(t_nubit32 freq) {
+    return MulDiv(vmachineGetTime(), freq, NS_PER_SEC);
+}
+/* Returns virtual clock at which a freq Hz device clock reaches ticks */
+t_nubit64 vmachineGetClock(t_nubit64 ticks, t_nubit32 freq) {
+    return GetClockAt(MulDivUp(ticks, NS_PER_SEC, freq));
+}
+/*
+ * Lets virtual time pass while cpu is halted: skips to the next deadline,
+ * or when paced, blocks until the deadline is due in host time or external
+ * input wakes the machine up, and only advances as far as host time went.
+ */
+void vmachineIdle() {
+    t_nubit64 deadline = vmachineGetDeadline();
+    t_nubit64 host, due, clock;
+    if (deadline <= vmachine.data.clock) {
+        return;
+    }
+    if (!vmachine.connect.flagPaced) {
+        if (deadline == Max64) {
+            /* only external input can wake the cpu up */
+            utilsWait(VMACHINE_IDLE_WAIT);
+        } else {
+            vmachine.data.clock = deadline;
+        }
+        return;
+    }
+    PaceStart();
+    due = (deadline == Max64) ? Max64 : vmachine.data.paceHost +
+          (GetTimeAt(deadline) - vmachine.data.paceTime) / 1000;
+    host = utilsGetTime();
+    if (host < due) {
+        utilsWait((due - host < VMACHINE_IDLE_WAIT) ? due - host : VMACHINE_IDLE_WAIT);
+        host = utilsGetTime();
+    }
+    if (host >= due) {
+        vmachine.data.clock = deadline;
+    } else {
+        clock = GetClockAt(vmachine.data.paceTime + (host - vmachine.data.paceHost) * 1000);
+        if (clock > vmachine.data.clock) {
+            vmachine.data.clock = clock;
+        }
+    }
+}
+/* Changes instructions per virtual second without moving virtual time */
+void vmachineSetSpeed(t_nubit32 ips, t_bool flagPaced) {
+    vmachine.data.timeBase = vmachineGetTime();
+    vmachine.data.clockBase = vmachine.data.clock;
+    vmachine.data.paceHost = 0;
+    vmachine.connect.ips = ips;
+    vmachine.connect.flagPaced = flagPaced;
+}
+
+/*
+ * Watches status reads for polling: the same read by the same instruction that
+ * keeps returning the same value within a few instructions, with registers and
+ * memory writes repeating in between, means the guest spins until some device
+ * changes, which cannot happen before the next event.
+ */
+void vmachineWatch(t_nubit32 addr, t_nubit32 value) {
+    t_nubit32 linear = vcpu.data.cs.base + vcpu.data.eip;
+    t_nubit32 write = vmachine.data.pollWrite;
+    t_nubit32 state = vcpu.data.eax;
+    state = state * 31 + vcpu.data.ecx;
+    state = state * 31 + vcpu.data.edx;
+    state = state * 31 + vcpu.data.ebx;
+    state = state * 31 + vcpu.data.esp;
+    state = state * 31 + vcpu.data.ebp;
+    state = state * 31 + vcpu.data.esi;
+    state = state * 31 + vcpu.data.edi;
+    vmachine.data.pollWrite = 0;
+    if (linear == vmachine.data.pollLinear && addr == vmachine.data.pollAddr &&
+        value == vmachine.data.pollValue && state == vmachine.data.pollState &&
+        vmachine.data.clock - vmachine.data.pollClock <= VMACHINE_POLL_GAP &&
+        /* writes are only folded in from the second read on */
+        (vmachine.data.pollCount < 2 || write == vmachine.data.pollWriteLast)) {
+        vmachine.data.pollWriteLast = write;
+        if (vmachine.data.pollCount < VMACHINE_POLL_COUNT) {
+            vmachine.data.pollCount++;
+        } else {
+            vmachine.data.flagPoll = True;
+        }
+    } else {
+        vmachine.data.pollLinear = linear;
+        vmachine.data.pollAddr = addr;
+        vmachine.data.pollValue = value;
+        vmachine.data.pollState = state;
+        vmachine.data.pollCount = 0;
+    }
+    vmachine.data.pollClock = vmachine.data.clock;
+}
+
 /* Initializes all devices, allocates space */
 void vmachineInit() {
+    MEMSET((void *)(&vmachine), Zero8, sizeof(t_machine));
+    vmachine.connect.ips = VMACHINE_IPS;
     vcpuInit();
     vfddInit();
     vhddInit();
@@ -70,6 +301,17 @@ void vmachineInit() {
 }
 /* Resets all devices to initial values */
 void vmachineReset() {
+    t_nubit8 id;
+    for (id = 0; id < vmachine.data.eventCount; ++id) {
+        vmachine.data.event[id].pos = VMACHINE_MAX_EVENT;
+    }
+    vmachine.data.heapCount = 0;
+    vmachine.data.clock = vmachine.data.clockBase = vmachine.data.timeBase = 0;
+    vmachine.data.paceHost = 0;
+    vmachine.data.pollWrite = 0;
+    vmachine.data.pollCount = 0;
+    vmachine.data.flagPoll = False;
+
     vhdcReset();
     _empty_
     vkbcReset();
@@ -91,36 +333,25 @@ void vmachineReset() {
     qdxReset();
     _vram_
 }
-/* Executes all devices in one loop */
+/*
+ * Executes devices with due events, then lets cpu run until the next deadline;
+ * devices without events are driven by their port accesses.
+ * A cpu found polling skips ahead to the next deadline.
+ */
 void vmachineRefresh() {
-    qdxRefresh();
-    _empty_
-    vbiosRefresh();
-    _empty_
-    vfddRefresh();
-    _empty_
-    vhdcRefresh();
-    _empty_
-    vhddRefresh();
-    _empty_
-    vkbcRefresh();
-    _empty_
-    vportRefresh();
-    _empty_
-    vvadpRefresh();
-    _empty_
-    vramRefresh();
-    _empty_
-
-    vcmosRefresh();
-    vfdcRefresh();
-    vdmaRefresh();
-    _vfdc_
-    vpicRefresh();
-    vpitRefresh();
-    _vpic_
+    ExecEvents();
+    _vpit_ _vdma_
     vcpuRefresh();
     _vpic_
+    if (vmachine.data.flagPoll) {
+        /* polling loop: let time pass as if cpu were halted */
+        vmachine.data.flagPoll = False;
+        vmachineIdle();
+        vmachine.data.pollClock = vmachine.data.clock;
+    }
+    if (vmachine.connect.flagPaced) {
+        Pace();
+    }
 }
 /* Finalize all devices, deallocates space */
 void vmachineFinal() {
@@ -152,11 +383,22 @@ void vmachineFinal() {
     vhddFinal();
     vramFinal();
 }
+/* Sets virtual speed in MIPS and paces to it, or runs at max speed if zero */
+void deviceConnectMachineSetSpeed(uint32_t mips) {
+    if (mips) {
+        vmachineSetSpeed(mips * 1000000, True);
+    } else {
+        vmachineSetSpeed(vmachine.connect.ips, False);
+    }
+}
+
 /* Print machine info */
 void devicePrintMachine() {
     PRINTF("Machine:           %s\n", NXVM_DEVICE_MACHINE);
-    PRINTF("CPU:               %s\n", NXVM_DEVICE_CPU);
+    PRINTF("CPU:               %s, %.2f MIPS, %s\n", NXVM_DEVICE_CPU,
+           vmachine.connect.ips / 1e6, vmachine.connect.flagPaced ? "paced" : "max speed");
     PRINTF("RAM Size:          %d MB\n", vram.connect.size >> 20);
+    PRINTF("Real Time Clock:   %s\n", vcmos.connect.flagFixed ? "fixed start date" : "host clock");
     PRINTF("Floppy Disk Drive: %s, %.2f MB, %s\n", NXVM_DEVICE_FDD,
            vfddGetImageSize * 1. / VFDD_BYTE_PER_MB,
            vfdd.connect.flagDiskExist ? "inserted" : "not inserted");
@@ -11,6 +11,71 @@ extern "C" {
 
 #define NXVM_DEVICE_MACHINE "IBM PC/AT"
 
+#define VMACHINE_MAX_EVENT 0x10
+
+/* default virtual speed in instructions per second */
+#define VMACHINE_IPS 10000000
+/* longest host wait in microseconds of a halted cpu before checking for stop */
+#define VMACHINE_IDLE_WAIT 20000
+/* repeated status reads, each within a few instructions, that make a polling loop */
+#define VMACHINE_POLL_COUNT 4
+#define VMACHINE_POLL_GAP   64
+
+typedef struct {
+    t_nubit64 time;    /* virtual time of deadline */
+    t_faddrcc fpEvent; /* action when deadline is due */
+    t_nubit8 pos;      /* position in heap, or VMACHINE_MAX_EVENT if not armed */
+} t_machine_event;
+
+typedef struct {
+    t_nubit64 clock; /* virtual time in executed instructions, advanced by cpu */
+    t_nubit64 clockBase, timeBase; /* clock and virtual nanoseconds at last speed change */
+    t_nubit64 paceHost, paceTime;  /* host microseconds and virtual nanoseconds to pace from */
+    t_machine_event event[VMACHINE_MAX_EVENT];
+    t_nubit8 heap[VMACHINE_MAX_EVENT]; /* min-heap of armed event ids */
+    t_nubit8 eventCount, heapCount;
+    t_nubit64 pollClock;  /* clock of last status read */
+    t_nubit32 pollLinear; /* instruction that did the read */
+    t_nubit32 pollAddr, pollValue; /* what was read and its value */
+    t_nubit32 pollState;  /* registers at the last status read */
+    t_nubit32 pollWrite;  /* memory writes since the last status read */
+    t_nubit32 pollWriteLast; /* memory writes of the last polling iteration */
+    t_nubit8 pollCount;   /* times the same read has repeated */
+    t_bool flagPoll;      /* guest polls a status that no device changes until next event */
+} t_machine_data;
+
+typedef struct {
+    t_nubit32 ips;    /* instructions per virtual second */
+    t_bool flagPaced; /* sleeps to hold ips against host time, or runs at max speed */
+} t_machine_connect;
+
+typedef struct {
+    t_machine_data data;
+    t_machine_connect connect;
+} t_machine;
+
+extern t_machine vmachine;
+
+t_nubit8 vmachineAddEvent(t_faddrcc fpEvent);
+void vmachineSetEvent(t_nubit8 id, t_nubit64 time);
+void vmachineClearEvent(t_nubit8 id);
+t_nubit64 vmachineGetDeadline();
+t_nubit64 vmachineGetTime();
+t_nubit64 vmachineGetTicks(t_nubit32 freq);
+t_nubit64 vmachineGetClock(t_nubit64 ticks, t_nubit32 freq);
+void vmachineSetSpeed(t_nubit32 ips, t_bool flagPaced);
+void vmachineIdle();
+void vmachineWatch(t_nubit32 addr, t_nubit32 value);
+/* folds a guest memory write into the state a polling loop must repeat,
+   only while a repeated status read is being tracked */
+#define vmachineWatchWrite(addr, value) do { \
+    if (vmachine.data.pollCount) { \
+        vmachine.data.pollWrite = (vmachine.data.pollWrite + (addr)) * 31 + (value); \
+    } \
+} while (0)
+/* a port write may change what the guest waits for */
+#define vmachineWatchOutput() (vmachine.data.pollCount = 0)
+
 void vmachineInit();
 void vmachineReset();
 void vmachineRefresh();
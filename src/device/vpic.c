@@ -84,6 +84,29 @@ static void RespondINTR(t_pic *rpic, t_nubit8 id) {
     }
 }
 
+/*
+ * UpdateINTR: Internal function
+ * Passes slave request into IR2 of master pic and recomputes INTR line;
+ * called whenever IRR, IMR, ISR or priorities change
+ */
+static void UpdateINTR() {
+    t_bool flagINTR;
+    if (vpic2.data.irr & (~vpic2.data.imr)) {
+        /* if slave pic has requested int, then
+         * pass the request into IR2 of master pic */
+        SetBit(vpic1.data.irr, VPIC_IRR_IRQ(2));
+    } else {
+        /* remove IR2 from master pic */
+        ClrBit(vpic1.data.irr, VPIC_IRR_IRQ(2));
+    }
+    flagINTR = HasINTR(&vpic1);
+    if (flagINTR && (VPIC_GetIntrTopId(&vpic1) == 2)) {
+        /* check slave pic */
+        flagINTR = HasINTR(&vpic2);
+    }
+    vpic1.connect.flagINTR = flagINTR;
+}
+
 /*
  * io_read_00x0
  * PIC provide POLL, IRR, ISR based on OCW3
@@ -228,6 +251,7 @@ static void io_write_00x0(t_pic *rpic) {
             }
         }
     }
+    UpdateINTR();
 }
 /*
  * io_read_00x1
@@ -303,6 +327,7 @@ static void io_write_00x1(t_pic *rpic) {
     default:
         break;
     }
+    UpdateINTR();
 }
 
 /* PIC1 provide POLL, IRR, ISR based on OCW3 */
@@ -369,20 +394,7 @@ void vpicSetIRQ(t_nubit8 irqId) {
     default:
         break;
     }
-}
-/*
- * vpicScanINTR
- * Returns true if system has a valid INTR
- * Called by CPU
- */
-t_bool vpicScanINTR() {
-    t_bool flagINTR;
-    flagINTR = HasINTR(&vpic1);
-    if (flagINTR && (VPIC_GetIntrTopId(&vpic1) == 2)) {
-        /* check slave pic */
-        flagINTR = HasINTR(&vpic2);
-    }
-    return flagINTR;
+    UpdateINTR();
 }
 /* Peeks highest priority interrupt without responding to IRQ */
 t_nubit8 vpicPeekINTR() {
@@ -407,6 +419,7 @@ t_nubit8 vpicPeekINTR() {
 t_nubit8 vpicGetINTR() {
     t_nubit8 reqId1; /* top requested int id in master pic */
     t_nubit8 reqId2; /* top requested int id in slave pic */
+    t_nubit8 intr;
     reqId1 = VPIC_GetIntrTopId(&vpic1);
     RespondINTR(&vpic1, reqId1);
     if (reqId1 == 0x02) {
@@ -414,11 +427,13 @@ t_nubit8 vpicGetINTR() {
         reqId2 = VPIC_GetIntrTopId(&vpic2);
         RespondINTR(&vpic2, reqId2);
         /* find the final int id based on slave ICW2 */
-        return (reqId2 | vpic2.data.icw2);
+        intr = reqId2 | vpic2.data.icw2;
     } else {
         /* find the final int id based on master ICW2 */
-        return (reqId1 | vpic1.data.icw2);
+        intr = reqId1 | vpic1.data.icw2;
     }
+    UpdateINTR();
+    return intr;
 }
 
 static void pitOut() {
@@ -444,17 +459,9 @@ void vpicReset() {
     MEMSET((void *)(&vpic2.data), Zero8, sizeof(t_pic_data));
     vpic1.data.status = vpic2.data.status = ICW1;
     vpic1.data.ocw3 = vpic2.data.ocw3 = VPIC_OCW3_RR;
+    UpdateINTR();
 }
-void vpicRefresh() {
-    if (vpic2.data.irr & (~vpic2.data.imr)) {
-        /* if slave pic has requested int, then
-         * pass the request into IR2 of master pic */
-        SetBit(vpic1.data.irr, VPIC_IRR_IRQ(2));
-    } else {
-        /* remove IR2 from master pic */
-        ClrBit(vpic1.data.irr, VPIC_IRR_IRQ(2));
-    }
-}
+void vpicRefresh() {}
 void vpicFinal() {}
 
 static void printPic(t_pic *rpic) {
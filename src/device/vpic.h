@@ -23,8 +23,13 @@ typedef struct {
     t_nubit8 irx; /* id of current top potential ir */
 } t_pic_data;
 
+typedef struct {
+    t_bool flagINTR; /* INTR line to cpu (master only) */
+} t_pic_connect;
+
 typedef struct {
     t_pic_data data;
+    t_pic_connect connect;
 } t_pic;
 
 extern t_pic vpic1, vpic2;
@@ -106,8 +111,10 @@ extern t_pic vpic1, vpic2;
 #define VPIC_GetIrrTopId(rpic)  (GetRegTopId((rpic), (rpic)->data.irr))
 #define VPIC_GetImrTopId(rpic)  (GetRegTopId((rpic), (rpic)->data.imr))
 
+/* Returns true if system has a valid INTR, as of the last pic state change */
+#define vpicScanINTR() (vpic1.connect.flagINTR)
+
 void vpicSetIRQ(t_nubit8 irqId);
-t_bool vpicScanINTR();
 t_nubit8 vpicPeekINTR();
 t_nubit8 vpicGetINTR();
 
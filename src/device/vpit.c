@@ -5,6 +5,7 @@
 #include "../utils.h"
 
 #include "vpic.h"
+#include "vmachine.h"
 
 #include "vbios.h"
 #include "vport.h"
@@ -12,6 +13,13 @@
 
 t_pit vpit;
 
+static t_nubit8 eventOut;
+
+#define Mode(id)    (VPIT_GetCW_M(vpit.data.cw[(id)]))
+#define FlagBCD(id) (GetBit(vpit.data.cw[(id)], VPIT_CW_BCD))
+/* count at which out signal is raised */
+#define Target(id)  ((Mode(id) == 0x02 || Mode(id) == 0x06) ? 0x0001 : Zero16)
+
 /* Initializes counter when status is ready */
 static void LoadInit(t_nubit8 id) {
     if (vpit.data.flagWrite[id] == VPIT_STATUS_RW_READY) {
@@ -19,26 +27,137 @@ static void LoadInit(t_nubit8 id) {
         vpit.data.flagReady[id] = True;
     }
 }
-/* Decreases count */
-static void Decrease(t_nubit8 id) {
-    vpit.data.count[id]--;
-    if (GetBit(vpit.data.cw[id], VPIT_CW_BCD)) {
-        if ((vpit.data.count[id] & 0x000f) == 0x000f) {
-            vpit.data.count[id] = (vpit.data.count[id] & 0xfff0) | 0x0009;
+/* Tests if each digit of count is decimal */
+static t_bool IsBCD(t_nubit16 count) {
+    return ((count & 0x000f) <= 0x0009) && ((count & 0x00f0) <= 0x0090) &&
+           ((count & 0x0f00) <= 0x0900) && ((count & 0xf000) <= 0x9000);
+}
+/* Returns count decreased by one */
+static t_nubit16 Decrease(t_nubit16 count, t_bool flagBCD) {
+    count--;
+    if (flagBCD) {
+        if ((count & 0x000f) == 0x000f) {
+            count = (count & 0xfff0) | 0x0009;
         }
-        if ((vpit.data.count[id] & 0x00f0) == 0x00f0) {
-            vpit.data.count[id] = (vpit.data.count[id] & 0xff0f) | 0x0090;
+        if ((count & 0x00f0) == 0x00f0) {
+            count = (count & 0xff0f) | 0x0090;
         }
-        if ((vpit.data.count[id] & 0x0f00) == 0x0f00) {
-            vpit.data.count[id] = (vpit.data.count[id] & 0xf0ff) | 0x0900;
+        if ((count & 0x0f00) == 0x0f00) {
+            count = (count & 0xf0ff) | 0x0900;
         }
-        if ((vpit.data.count[id] & 0xf000) == 0xf000) {
-            vpit.data.count[id] = (vpit.data.count[id] & 0x0fff) | 0x9000;
+        if ((count & 0xf000) == 0xf000) {
+            count = (count & 0x0fff) | 0x9000;
         }
     }
+    return count;
+}
+/* Returns count decreased n times */
+static t_nubit16 DecreaseBy(t_nubit16 count, t_bool flagBCD, t_nubit64 n) {
+    t_nubit16 value;
+    if (!flagBCD) {
+        return GetMax16(count - n);
+    }
+    /* steps through non-decimal digits one by one */
+    while (n && !IsBCD(count)) {
+        count = Decrease(count, True);
+        n--;
+    }
+    if (!n) {
+        return count;
+    }
+    value = BCD2Hex(count) + BCD2Hex(count >> 8) * 100;
+    value = (value + 10000 - n % 10000) % 10000;
+    return Hex2BCD(value % 100) | (Hex2BCD(value / 100) << 8);
+}
+/* Returns number of decreases (at least one) for count to reach target */
+static t_nubit64 GetDistance(t_nubit16 count, t_bool flagBCD, t_nubit16 target) {
+    t_nubit64 n = 0;
+    if (!flagBCD) {
+        return GetMax16(count - target - 1) + 1;
+    }
+    while (!IsBCD(count)) {
+        count = Decrease(count, True);
+        n++;
+    }
+    if (n && count == target) {
+        return n;
+    }
+    return n + (BCD2Hex(count) + BCD2Hex(count >> 8) * 100 + 10000 - target - 1) % 10000 + 1;
+}
+/* Tests if counter is counting down */
+static t_bool IsCounting(t_nubit8 id) {
+    if (!vpit.data.flagReady[id]) {
+        return False;
+    }
+    switch (Mode(id)) {
+    case 0x01:
+    case 0x05:
+        return True;
+    default:
+        return vpit.connect.flagGate[id];
+    }
+}
+/* Raises out signal when count has reached target */
+static void ExecOut(t_nubit8 id) {
+    ExecFun(vpit.connect.fpOut[id]);
+    switch (Mode(id)) {
+    case 0x02:
+    case 0x03:
+    case 0x06:
+    case 0x07:
+        LoadInit(id);
+        break;
+    default:
+        vpit.data.flagReady[id] = False;
+        break;
+    }
+}
+/* Brings counter to tick now, raising the out signals passed by */
+static void Update(t_nubit8 id, t_nubit64 now) {
+    t_nubit64 tick;
+    while (IsCounting(id)) {
+        tick = vpit.data.start[id] + GetDistance(vpit.data.count[id], FlagBCD(id), Target(id));
+        if (tick > now) {
+            vpit.data.count[id] = DecreaseBy(vpit.data.count[id], FlagBCD(id),
+                                             now - vpit.data.start[id]);
+            break;
+        }
+        vpit.data.count[id] = Target(id);
+        vpit.data.start[id] = tick;
+        ExecOut(id);
+    }
+    vpit.data.start[id] = now;
+}
+/* Brings all counters to current virtual time */
+static void Sync() {
+    t_nubit8 id;
+    t_nubit64 now = vmachineGetTicks(VPIT_FREQ);
+    for (id = 0; id < 3; ++id) {
+        Update(id, now);
+    }
+}
+/* Schedules refresh at the next out signal connected to a device */
+static void Schedule() {
+    t_nubit8 id;
+    t_nubit64 tick, next = Max64;
+    for (id = 0; id < 3; ++id) {
+        if (vpit.connect.fpOut[id] && IsCounting(id)) {
+            tick = vpit.data.start[id] +
+                   GetDistance(vpit.data.count[id], FlagBCD(id), Target(id));
+            if (tick < next) {
+                next = tick;
+            }
+        }
+    }
+    if (next == Max64) {
+        vmachineClearEvent(eventOut);
+    } else {
+        vmachineSetEvent(eventOut, vmachineGetClock(next, VPIT_FREQ));
+    }
 }
 
 static void io_read_004x(t_nubit8 id) {
+    Sync();
     if (vpit.data.flagLatch[id]) {
         if (vpit.data.flagRead[id] == VPIT_STATUS_RW_MSB) {
             vport.data.ioByte = GetMax8(vpit.data.latch[id] >> 8);
@@ -76,6 +195,7 @@ static void io_read_004x(t_nubit8 id) {
     }
 }
 static void io_write_004x(t_nubit8 id) {
+    Sync();
     switch (VPIT_GetCW_RW(vpit.data.cw[id])) {
     case 0x00:
         return;
@@ -127,6 +247,7 @@ static void io_write_004x(t_nubit8 id) {
     default:
         break;
     }
+    Schedule();
 }
 
 /* read counter 0 */
@@ -156,6 +277,7 @@ static void io_write_0042() {
 /* write control word */
 static void io_write_0043() {
     t_nubit8 id = VPIT_GetCW_SC(vport.data.ioByte);
+    Sync();
     if (id == (VPIT_CW_SC >> 6)) {
         /* read-back command */
         vpit.data.cw[id] = vport.data.ioByte;
@@ -197,16 +319,19 @@ static void io_write_0043() {
             ExecFun(vpit.connect.fpOut[id]);
         }
     }
+    Schedule();
 }
 
 /* set gate value and load init */
 void vpitSetGate(t_nubit8 id, t_bool flagGate) {
+    Sync();
     if (VPIT_GetCW_M(vpit.data.cw[id]) != Zero8) {
         if (!vpit.connect.flagGate[id] && flagGate) {
             LoadInit(id);
         }
     }
     vpit.connect.flagGate[id] = flagGate;
+    Schedule();
 }
 void vpitAddDevice(t_nubit8 id, t_faddrcc fpOut) {
     vpit.connect.fpOut[id] = fpOut;
@@ -224,6 +349,7 @@ void vpitInit() {
     vportAddWrite(0x0042, (t_faddrcc) io_write_0042);
     vportAddWrite(0x0043, (t_faddrcc) io_write_0043);
     vbiosAddPost(VPIT_POST);
+    eventOut = vmachineAddEvent((t_faddrcc) vpitRefresh);
 }
 void vpitReset() {
     t_nubitcc i;
@@ -231,80 +357,13 @@ void vpitReset() {
     for (i = 0; i < 3; ++i) {
         vpit.data.flagReady[i] = vpit.data.flagLatch[i] = True;
         vpit.data.flagRead[i] = vpit.data.flagWrite[i] = VPIT_STATUS_RW_READY;
+        vpit.data.start[i] = vmachineGetTicks(VPIT_FREQ);
     }
+    vpitRefresh();
 }
 void vpitRefresh() {
-    t_nubitcc i;
-    for (i = 0; i < 3; ++i) {
-        switch (VPIT_GetCW_M(vpit.data.cw[i])) {
-        case 0x00:
-            if (vpit.data.flagReady[i]) {
-                if (vpit.connect.flagGate[i]) {
-                    Decrease(GetMax8(i));
-                    if (vpit.data.count[i] == Zero16) {
-                        ExecFun(vpit.connect.fpOut[i]);
-                        vpit.data.flagReady[i] = False;
-                    }
-                }
-            }
-            break;
-        case 0x01:
-            if (vpit.data.flagReady[i]) {
-                Decrease(GetMax8(i));
-                if (vpit.data.count[i] == Zero16) {
-                    ExecFun(vpit.connect.fpOut[i]);
-                    vpit.data.flagReady[i] = False;
-                }
-            }
-            break;
-        case 0x02:
-        case 0x06:
-            if (vpit.data.flagReady[i]) {
-                if (vpit.connect.flagGate[i]) {
-                    Decrease(GetMax8(i));
-                    if (vpit.data.count[i] == 0x0001) {
-                        ExecFun(vpit.connect.fpOut[i]);
-                        LoadInit(GetMax8(i));
-                    }
-                }
-            }
-            break;
-        case 0x03:
-        case 0x07:
-            if (vpit.data.flagReady[i]) {
-                if (vpit.connect.flagGate[i]) {
-                    Decrease(GetMax8(i));
-                    if (vpit.data.count[i] == Zero16) {
-                        ExecFun(vpit.connect.fpOut[i]);
-                        LoadInit(GetMax8(i));
-                    }
-                }
-            }
-            break;
-        case 0x04:
-            if (vpit.data.flagReady[i]) {
-                if (vpit.connect.flagGate[i]) {
-                    Decrease(GetMax8(i));
-                    if (vpit.data.count[i] == Zero16) {
-                        ExecFun(vpit.connect.fpOut[i]);
-                        vpit.data.flagReady[i] = False;
-                    }
-                }
-            }
-            break;
-        case 0x05:
-            if (vpit.data.flagReady[i]) {
-                Decrease(GetMax8(i));
-                if (vpit.data.count[i] == Zero16) {
-                    ExecFun(vpit.connect.fpOut[i]);
-                    vpit.data.flagReady[i] = False;
-                }
-            }
-            break;
-        default:
-            break;
-        }
-    }
+    Sync();
+    Schedule();
 }
 void vpitFinal() {}
 
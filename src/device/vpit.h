@@ -30,6 +30,8 @@ typedef struct {
 
     t_pit_data_status_rw flagRead[3];  /* flag of low byte read */
     t_pit_data_status_rw flagWrite[3]; /* flag of low byte write */
+
+    t_nubit64 start[3]; /* input clock tick at which count was taken */
 } t_pit_data;
 
 typedef struct {
@@ -76,6 +78,9 @@ extern t_pit vpit;
 #define VPIT_SB_NC  0x40 /* null count (1) or count available (0) */
 #define VPIT_SB_OUT 0x80 /* state of out pin high(1) or low(0) */
 
+/* input clock frequency in Hz */
+#define VPIT_FREQ 1193182
+
 void vpitSetGate(t_nubit8 id, t_bool flagGate);
 
 #define vpitAddMe(id) vpitAddDevice((id), (t_faddrcc) pitOut);
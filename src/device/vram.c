@@ -19,6 +19,12 @@ static void allocate(t_nubitcc newsize) {
         }
         vram.connect.pBase = (t_vaddrcc) MALLOC(vram.connect.size);
         MEMSET((void *) vram.connect.pBase, Zero8, vram.connect.size);
+        vram.connect.npage = (vram.connect.size >> VRAM_PAGE_SHIFT) + 1;
+        if (vram.connect.pVersion) {
+            FREE((void *) vram.connect.pVersion);
+        }
+        vram.connect.pVersion = (t_nubit32 *) MALLOC(vram.connect.npage * sizeof(t_nubit32));
+        MEMSET((void *) vram.connect.pVersion, Zero8, vram.connect.npage * sizeof(t_nubit32));
     }
 }
 static void io_read_0092() {
@@ -36,6 +42,15 @@ void vramReadPhysical(t_nubit32 physical, t_vaddrcc rdest, t_nubitcc byte) {
 }
 void vramWritePhysical(t_nubit32 physical, t_vaddrcc rsrc, t_nubitcc byte) {
     MEMCPY((void *) VRAM_GetAddr(physical), (void *) rsrc, byte);
+    vramMarkPhysical(physical, byte);
+}
+/* Invalidates anything cached from the pages being written */
+void vramMarkPhysical(t_nubit32 physical, t_nubitcc byte) {
+    t_nubit32 page;
+    if (!byte) return;
+    for (page = physical >> VRAM_PAGE_SHIFT; page <= ((physical + byte - 1) >> VRAM_PAGE_SHIFT); ++page) {
+        VRAM_GetVersion(page << VRAM_PAGE_SHIFT)++;
+    }
 }
 
 #define pitOut ((t_faddrcc) NULL)
@@ -56,6 +71,9 @@ void vramFinal() {
     if (vram.connect.pBase) {
         FREE((void *) vram.connect.pBase);
     }
+    if (vram.connect.pVersion) {
+        FREE((void *) vram.connect.pVersion);
+    }
 }
 
 void deviceConnectRamAllocate(size_t newsize) {
@@ -66,4 +84,5 @@ void deviceConnectRamRealRead(uint16_t seg, uint16_t off, void *rdest, size_t si
 }
 void deviceConnectRamRealWrite(uint16_t seg, uint16_t off, void *rsrc, size_t size) {
     MEMCPY((void *) vramGetRealAddr(seg, off), rsrc, size);
+    vramMarkPhysical((t_nubit32)(vramGetRealAddr(seg, off) - vram.connect.pBase), size);
 }
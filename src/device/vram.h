@@ -18,6 +18,8 @@ typedef struct {
 typedef struct {
     t_vaddrcc pBase; /* memory base address is 20 bit */
     t_nubitcc size; /* memory size in byte */
+    t_nubit32 *pVersion; /* write counter of each page */
+    t_nubitcc npage; /* number of pages */
 } t_ram_connect;
 
 typedef struct {
@@ -33,6 +35,11 @@ extern t_ram vram;
 #define VRAM_WrapA20(offset)   ((offset) & (vram.data.flagA20 ? Max32 : ~VRAM_BIT_A20))
 #define VRAM_GetAddr(physical) (vram.connect.pBase + (t_vaddrcc)(VRAM_WrapA20(physical)))
 
+/* page version is increased each time the page is written */
+#define VRAM_PAGE_SHIFT 12
+#define VRAM_GetPage(physical)    ((VRAM_WrapA20(physical) >> VRAM_PAGE_SHIFT) % vram.connect.npage)
+#define VRAM_GetVersion(physical) (vram.connect.pVersion[VRAM_GetPage(physical)])
+
 /* macros below are defined for real-addressing mode */
 #define vramGetRealAddr(segment, offset) (vram.connect.pBase + \
     (VRAM_WrapA20((GetMax16(segment) << 4) + GetMax16(offset)) % vram.connect.size))
@@ -43,6 +50,7 @@ extern t_ram vram;
 
 void vramReadPhysical(t_nubit32 physical, t_vaddrcc rdest, t_nubitcc size);
 void vramWritePhysical(t_nubit32 physical, t_vaddrcc rsrc, t_nubitcc size);
+void vramMarkPhysical(t_nubit32 physical, t_nubitcc size);
 
 void vramInit();
 void vramReset();
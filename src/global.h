@@ -35,6 +35,7 @@ extern "C" {
 #include <stdarg.h>
 #include <string.h>
 #include <memory.h>
+#include <setjmp.h>
 #include <time.h>
 
 /* COMPATIBILITY DEFINITIONS *********************************************** */
@@ -2,7 +2,10 @@
 
 /* LINUX provides linux platform interface. */
 
+#include <time.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include "linuxcon.h"
 #include "linux.h"
@@ -10,6 +13,55 @@
 void linuxSleep(uint32_t milisec) {
     usleep((milisec) * 1000);
 }
+/* returns monotonic host time in microseconds */
+uint64_t linuxGetTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static pthread_mutex_t mutexWake = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condWake = PTHREAD_COND_INITIALIZER;
+static int flagWake = 0;
+
+/* blocks until woken or the timeout in microseconds expires;
+   a wake that arrives while nobody waits is kept for the next wait */
+void linuxWait(uint64_t microsec) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += microsec / 1000000;
+    ts.tv_nsec += (microsec % 1000000) * 1000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&mutexWake);
+    while (!flagWake) {
+        if (pthread_cond_timedwait(&condWake, &mutexWake, &ts)) {
+            break;
+        }
+    }
+    flagWake = 0;
+    pthread_mutex_unlock(&mutexWake);
+}
+void linuxWake() {
+    pthread_mutex_lock(&mutexWake);
+    flagWake = 1;
+    pthread_cond_signal(&condWake);
+    pthread_mutex_unlock(&mutexWake);
+}
+
+/* allocates memory that can hold generated host code */
+void *linuxAllocExec(size_t size) {
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (ptr == MAP_FAILED) ? NULL : ptr;
+}
+void linuxFreeExec(void *ptr, size_t size) {
+    if (ptr) {
+        munmap(ptr, size);
+    }
+}
 
 void linuxDisplaySetScreen(int window) {
     if (window) {
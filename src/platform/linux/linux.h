@@ -10,6 +10,11 @@
 #include "../../global.h"
 
 void linuxSleep(uint32_t milisec);
+uint64_t linuxGetTime();
+void linuxWait(uint64_t microsec);
+void linuxWake();
+void *linuxAllocExec(size_t size);
+void linuxFreeExec(void *ptr, size_t size);
 void linuxDisplaySetScreen(int window);
 void linuxDisplayPaint(int window);
 void linuxStartMachine(int window);
@@ -13,6 +13,15 @@ t_platform platform;
 void platformSleep(uint32_t milisec) {
     win32Sleep(milisec);
 }
+uint64_t platformGetTime() {
+    return win32GetTime();
+}
+void platformWait(uint64_t microsec) {
+    win32Wait(microsec);
+}
+void platformWake() {
+    win32Wake();
+}
 void platformDisplaySetScreen() {
     win32DisplaySetScreen(platform.flagMode);
 }
@@ -22,11 +31,25 @@ void platformDisplayPaint() {
 void platformStart() {
     win32StartMachine(platform.flagMode);
 }
+void *platformAllocExec(size_t size) {
+    /* host code generation is not supported on win32 */
+    return NULL;
+}
+void platformFreeExec(void *ptr, size_t size) {}
 #elif GLOBAL_PLATFORM == GLOBAL_VAR_LINUX
 #include "linux/linux.h"
 void platformSleep(uint32_t milisec) {
     linuxSleep(milisec);
 }
+uint64_t platformGetTime() {
+    return linuxGetTime();
+}
+void platformWait(uint64_t microsec) {
+    linuxWait(microsec);
+}
+void platformWake() {
+    linuxWake();
+}
 void platformDisplaySetScreen() {
     linuxDisplaySetScreen(platform.flagMode);
 }
@@ -36,6 +59,12 @@ void platformDisplayPaint() {
 void platformStart() {
     linuxStartMachine(platform.flagMode);
 }
+void *platformAllocExec(size_t size) {
+    return linuxAllocExec(size);
+}
+void platformFreeExec(void *ptr, size_t size) {
+    linuxFreeExec(ptr, size);
+}
 #endif
 
 void platformInit() {
@@ -19,6 +19,11 @@ extern t_platform platform;
 void platformDisplaySetScreen();
 void platformDisplayPaint();
 void platformSleep(uint32_t milisec);
+uint64_t platformGetTime();
+void platformWait(uint64_t microsec);
+void platformWake();
+void *platformAllocExec(size_t size);
+void platformFreeExec(void *ptr, size_t size);
 
 void platformStart();
 
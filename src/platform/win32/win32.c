@@ -275,6 +275,22 @@ VOID win32KeyboardMakeKey(UCHAR scanCode, UCHAR virtualKey) {
     deviceConnectKeyboardRecvKeyPress(code);
 }
 
+static HANDLE hEventWake = NULL;
+
+/* blocks until woken or the timeout in microseconds expires */
+VOID win32Wait(uint64_t microsec) {
+    if (hEventWake) {
+        WaitForSingleObject(hEventWake, (DWORD) ((microsec + 999) / 1000));
+    } else {
+        Sleep((DWORD) ((microsec + 999) / 1000));
+    }
+}
+VOID win32Wake() {
+    if (hEventWake) {
+        SetEvent(hEventWake);
+    }
+}
+
 VOID win32DisplaySetScreen(BOOL flagWindow) {
     if (flagWindow) {
         win32appDisplaySetScreen();
@@ -292,6 +308,9 @@ VOID win32DisplayPaint(BOOL flagWindow) {
 }
 
 VOID win32StartMachine(BOOL flagWindow) {
+    if (!hEventWake) {
+        hEventWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+    }
     if (flagWindow) {
         win32appStartMachine();
     } else {
@@ -13,6 +13,9 @@ VOID win32KeyboardMakeStatus();
 VOID win32KeyboardMakeKey(UCHAR scanCode, UCHAR virtualKey);
 
 #define win32Sleep Sleep
+#define win32GetTime() ((uint64_t) GetTickCount() * 1000)
+VOID win32Wait(uint64_t microsec);
+VOID win32Wake();
 VOID win32DisplaySetScreen(BOOL flagWindow);
 VOID win32DisplayPaint(BOOL flagWindow);
 VOID win32StartMachine(BOOL flagWindow);
@@ -184,14 +184,37 @@ void* MEMSET(void *_Dst, int _Val, size_t _Size) {
 void* MEMCPY(void *_Dst, const void *_Src, size_t _Size) {
     return memcpy(_Dst, _Src, _Size);
 }
+void* MEMMOVE(void *_Dst, const void *_Src, size_t _Size) {
+    return memmove(_Dst, _Src, _Size);
+}
 int MEMCMP(const void *_Buf1, const void *_Buf2, size_t _Size) {
     return memcmp(_Buf1, _Buf2, _Size);
 }
+void* MEMCHR(const void *_Buf, int _Val, size_t _MaxCount) {
+    return (void *) memchr(_Buf, _Val, _MaxCount);
+}
 
 /* General Functions */
 void utilsSleep(uint32_t milisec) {
     platformSleep(milisec);
 }
+/* returns host time in microseconds for pacing */
+uint64_t utilsGetTime() {
+    return platformGetTime();
+}
+/* blocks the calling thread until utilsWake or the timeout */
+void utilsWait(uint64_t microsec) {
+    platformWait(microsec);
+}
+void utilsWake() {
+    platformWake();
+}
+void *utilsAllocExec(size_t size) {
+    return platformAllocExec(size);
+}
+void utilsFreeExec(void *ptr, size_t size) {
+    platformFreeExec(ptr, size);
+}
 void utilsLowerStr(char *str) {
     size_t i = 0;
     if (str[0] == '\'') {
@@ -121,10 +121,17 @@ void* MALLOC(size_t _Size);
 void  FREE(void *_Memory);
 void* MEMSET(void *_Dst, int _Val, size_t _Size);
 void* MEMCPY(void *_Dst, const void *_Src, size_t _Size);
+void* MEMMOVE(void *_Dst, const void *_Src, size_t _Size);
 int   MEMCMP(const void *_Buf1, const void *_Buf2, size_t _Size);
+void* MEMCHR(const void *_Buf, int _Val, size_t _MaxCount);
 
 /* NXVM Library */
 void utilsSleep(uint32_t milisec);
+uint64_t utilsGetTime();
+void utilsWait(uint64_t microsec);
+void utilsWake();
+void *utilsAllocExec(size_t size);
+void utilsFreeExec(void *ptr, size_t size);
 void utilsLowerStr(char *str);
 
 /* NXVM Assembler Library */